@@ -0,0 +1,39 @@
+#include "allocation_counter.hpp"
+
+#ifdef TEXTURE_PACKER_COUNT_ALLOCATIONS
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+std::atomic<size_t> num_allocations = 0;
+
+// the array and nothrow forms forward to this one by default, so they are counted too
+void *operator new(std::size_t size) {
+    num_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (size == 0) {
+        size = 1;
+    }
+    // like the standard one, give the new handler a chance to free memory before giving up
+    while (true) {
+        if (void *pointer = std::malloc(size)) {
+            return pointer;
+        }
+        std::new_handler handler = std::get_new_handler();
+        if (!handler) {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+void operator delete(void *pointer) noexcept { std::free(pointer); }
+void operator delete(void *pointer, std::size_t) noexcept { std::free(pointer); }
+
+size_t get_num_allocations() { return num_allocations.load(std::memory_order_relaxed); }
+
+#else
+
+size_t get_num_allocations() { return 0; }
+
+#endif
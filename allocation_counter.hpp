@@ -0,0 +1,28 @@
+#ifndef ALLOCATION_COUNTER_HPP
+#define ALLOCATION_COUNTER_HPP
+
+#include <cstddef>
+
+/**
+ * @brief Whether heap allocations are being counted, see get_num_allocations.
+ */
+#ifdef TEXTURE_PACKER_COUNT_ALLOCATIONS
+inline constexpr bool allocation_counting_enabled = true;
+#else
+inline constexpr bool allocation_counting_enabled = false;
+#endif
+
+/**
+ * @brief The number of heap allocations the whole program has made so far.
+ *
+ * Allocations are only counted when built with TEXTURE_PACKER_COUNT_ALLOCATIONS defined, which replaces the global
+ * operator new, otherwise this is always zero. It's meant for measuring how much the packing path allocates during
+ * development, not for release builds.
+ *
+ * The count is process wide, every thread adds to the same counter. The difference between two calls therefore also
+ * includes whatever other threads allocated in between, which is what measuring the packing search needs since it
+ * runs on worker threads, but it is only an exact count of one code path when nothing else is running.
+ */
+size_t get_num_allocations();
+
+#endif // ALLOCATION_COUNTER_HPP
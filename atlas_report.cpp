@@ -0,0 +1,107 @@
+#include "atlas_report.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <fstream>
+
+PixelRect find_largest_free_rect(int side_length, const std::vector<PixelRect> &used_rects) {
+    // every edge of a used rect becomes a grid line, the cells between the lines are either fully used or fully free
+    std::vector<int> xs = {0, side_length};
+    std::vector<int> ys = {0, side_length};
+    for (const auto &rect : used_rects) {
+        xs.push_back(std::clamp(rect.x, 0, side_length));
+        xs.push_back(std::clamp(rect.x + rect.width, 0, side_length));
+        ys.push_back(std::clamp(rect.y, 0, side_length));
+        ys.push_back(std::clamp(rect.y + rect.height, 0, side_length));
+    }
+    std::sort(xs.begin(), xs.end());
+    xs.erase(std::unique(xs.begin(), xs.end()), xs.end());
+    std::sort(ys.begin(), ys.end());
+    ys.erase(std::unique(ys.begin(), ys.end()), ys.end());
+
+    size_t num_columns = xs.size() - 1;
+    size_t num_rows = ys.size() - 1;
+    std::vector<char> used(num_columns * num_rows, 0);
+    for (const auto &rect : used_rects) {
+        size_t column_begin = std::lower_bound(xs.begin(), xs.end(), std::clamp(rect.x, 0, side_length)) - xs.begin();
+        size_t column_end =
+            std::lower_bound(xs.begin(), xs.end(), std::clamp(rect.x + rect.width, 0, side_length)) - xs.begin();
+        size_t row_begin = std::lower_bound(ys.begin(), ys.end(), std::clamp(rect.y, 0, side_length)) - ys.begin();
+        size_t row_end =
+            std::lower_bound(ys.begin(), ys.end(), std::clamp(rect.y + rect.height, 0, side_length)) - ys.begin();
+        for (size_t row = row_begin; row < row_end; ++row) {
+            std::fill(used.begin() + row * num_columns + column_begin, used.begin() + row * num_columns + column_end,
+                      1);
+        }
+    }
+
+    // the usual largest rectangle in a histogram, row by row, except that columns have different widths
+    PixelRect largest_free_rect;
+    std::vector<int> free_heights(num_columns, 0);
+    struct Bar {
+        int x;
+        int height;
+    };
+    std::vector<Bar> bars;
+
+    for (size_t row = 0; row < num_rows; ++row) {
+        int row_bottom = ys[row + 1];
+        for (size_t column = 0; column < num_columns; ++column) {
+            free_heights[column] = used[row * num_columns + column] ? 0 : free_heights[column] + ys[row + 1] - ys[row];
+        }
+
+        bars.clear();
+        for (size_t column = 0; column <= num_columns; ++column) {
+            int height = column < num_columns ? free_heights[column] : 0;
+            int x = xs[column];
+            int start_x = x;
+            while (!bars.empty() && bars.back().height >= height) {
+                Bar bar = bars.back();
+                bars.pop_back();
+                PixelRect candidate{bar.x, row_bottom - bar.height, x - bar.x, bar.height};
+                if (candidate.area() > largest_free_rect.area()) {
+                    largest_free_rect = candidate;
+                }
+                start_x = bar.x;
+            }
+            bars.push_back({start_x, height});
+        }
+    }
+
+    return largest_free_rect;
+}
+
+nlohmann::json pixel_rect_to_json(const PixelRect &rect) {
+    return {{"x", rect.x}, {"y", rect.y}, {"width", rect.width}, {"height", rect.height}};
+}
+
+std::string AtlasReport::to_json_string() const {
+    nlohmann::json containers_json = nlohmann::json::array();
+    for (const auto &container : containers) {
+        containers_json.push_back({{"format", container.format},
+                                   {"container_index", container.container_index},
+                                   {"side_length", container.side_length},
+                                   {"num_textures", container.num_textures},
+                                   {"used_area", container.used_area},
+                                   {"free_area", container.free_area},
+                                   {"largest_free_rect", pixel_rect_to_json(container.largest_free_rect)},
+                                   {"occupancy", container.occupancy},
+                                   {"fragmentation", container.fragmentation},
+                                   {"bytes", container.bytes}});
+    }
+
+    nlohmann::json report = {{"containers", containers_json},
+                             {"used_area", used_area},
+                             {"free_area", free_area},
+                             {"texture_array_bytes", texture_array_bytes},
+                             {"bounding_box_texture_bytes", bounding_box_texture_bytes},
+                             {"indirection_table_bytes", indirection_table_bytes},
+                             {"total_gpu_bytes", total_gpu_bytes}};
+    return report.dump(4);
+}
+
+void AtlasReport::write_json(const std::filesystem::path &file_path) const {
+    std::ofstream file(file_path);
+    file << to_json_string();
+}
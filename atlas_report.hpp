@@ -0,0 +1,77 @@
+#ifndef ATLAS_REPORT_HPP
+#define ATLAS_REPORT_HPP
+
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+struct PixelRect {
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+
+    long long area() const { return static_cast<long long>(width) * height; }
+};
+
+/**
+ * @brief Finds the largest empty axis aligned rectangle in a square container.
+ *
+ * The coordinates are compressed to the edges of the used rects, so this takes time proportional to the square of the
+ * number of rects rather than to the area of the container.
+ *
+ * @param side_length The side length of the container.
+ * @param used_rects The rects which are taken, they must not overlap.
+ * @return The largest free rect, with zero area if the container is full.
+ */
+PixelRect find_largest_free_rect(int side_length, const std::vector<PixelRect> &used_rects);
+
+/**
+ * @brief How well a single container (one layer of a texture array) is used.
+ */
+struct ContainerReport {
+    std::string format;
+    int container_index = 0;
+    int side_length = 0;
+    int num_textures = 0;
+    long long used_area = 0;
+    long long free_area = 0;
+    /// the biggest texture that could still be added to this container without moving anything
+    PixelRect largest_free_rect;
+    /// used area divided by the area of the container
+    double occupancy = 0.0;
+    /// how scattered the free area is, 0 when it's a single rectangle and approaching 1 the more it is split up
+    double fragmentation = 0.0;
+    /// the gpu memory of this layer, when layers are paged it's only taken while the container is resident
+    size_t bytes = 0;
+};
+
+/**
+ * @brief A summary of how efficient a bake is and how much gpu memory it takes.
+ */
+struct AtlasReport {
+    /// every container of every format, ordered by format and then container index
+    std::vector<ContainerReport> containers;
+    long long used_area = 0;
+    long long free_area = 0;
+    /// the texture arrays of every format
+    size_t texture_array_bytes = 0;
+    /// the 1d texture holding the bounding box of every texture
+    size_t bounding_box_texture_bytes = 0;
+    /// the container to layer tables of formats whose layers are paged
+    size_t indirection_table_bytes = 0;
+    size_t total_gpu_bytes = 0;
+
+    /**
+     * @return The report as indented json.
+     */
+    std::string to_json_string() const;
+
+    /**
+     * @brief Writes the report to a json file.
+     */
+    void write_json(const std::filesystem::path &file_path) const;
+};
+
+#endif // ATLAS_REPORT_HPP
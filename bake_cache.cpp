@@ -0,0 +1,172 @@
+#include "bake_cache.hpp"
+#include "sbpt_generated_includes.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <random>
+#include <sstream>
+
+void ContentHash::update(std::string_view data) {
+    constexpr uint64_t fnv_prime = 0x100000001b3ULL;
+    for (unsigned char c : data) {
+        low = (low ^ c) * fnv_prime;
+        high = (high ^ c) * fnv_prime;
+        // keep the two halves from staying in lockstep
+        high ^= low >> 29;
+    }
+}
+
+void ContentHash::update(const std::vector<uint8_t> &data) {
+    update(std::string_view(reinterpret_cast<const char *>(data.data()), data.size()));
+}
+
+void ContentHash::update_field(std::string_view data) {
+    update(std::to_string(data.size()) + ":");
+    update(data);
+}
+
+std::string ContentHash::hex_digest() const {
+    std::ostringstream digest;
+    digest << std::hex << std::setfill('0') << std::setw(16) << high << std::setw(16) << low;
+    return digest.str();
+}
+
+BakeCache::BakeCache(const std::filesystem::path &cache_directory, std::uintmax_t max_size_bytes)
+    : cache_directory(cache_directory), max_size_bytes(max_size_bytes) {
+    std::error_code error;
+    std::filesystem::create_directories(cache_directory, error);
+    if (error) {
+        global_logger.error("Couldn't create bake cache directory {}: {}", cache_directory.string(), error.message());
+    }
+}
+
+bool BakeCache::fetch(
+    const std::string &key, const std::filesystem::path &output_dir,
+    const std::function<std::vector<std::string>(const std::filesystem::path &)> &list_bundle_filenames) {
+    std::filesystem::path entry_directory = cache_directory / key;
+
+    // another machine may evict the entry while we are reading it, in that case it's just a miss
+    try {
+        if (!std::filesystem::is_directory(entry_directory)) {
+            return false;
+        }
+
+        for (const auto &entry : std::filesystem::directory_iterator(entry_directory)) {
+            std::filesystem::path destination = output_dir / entry.path().filename();
+            std::filesystem::remove(destination);
+
+            std::error_code link_error;
+            std::filesystem::create_hard_link(entry.path(), destination, link_error);
+            if (link_error) {
+                std::filesystem::copy_file(entry.path(), destination,
+                                           std::filesystem::copy_options::overwrite_existing);
+            }
+        }
+
+        std::filesystem::last_write_time(entry_directory, std::filesystem::file_time_type::clock::now());
+    } catch (const std::filesystem::filesystem_error &e) {
+        global_logger.warn("Couldn't fetch bake cache entry {}: {}", key, e.what());
+        return false;
+    }
+
+    // an entry is only ever published whole, so a file missing from it means it was damaged afterwards and it would
+    // keep failing everyone who fetches it, it is dropped so the next store can replace it
+    std::string missing_filename;
+    try {
+        for (const auto &filename : list_bundle_filenames(output_dir)) {
+            if (!std::filesystem::exists(output_dir / filename)) {
+                missing_filename = filename;
+                break;
+            }
+        }
+    } catch (const std::exception &e) {
+        missing_filename = std::string("the file list (") + e.what() + ")";
+    }
+    if (!missing_filename.empty()) {
+        global_logger.warn("Bake cache entry {} is missing {}, treating it as a miss", key, missing_filename);
+        std::error_code error;
+        std::filesystem::remove_all(entry_directory, error);
+        return false;
+    }
+
+    global_logger.info("Bake cache hit for {}", key);
+    return true;
+}
+
+void BakeCache::store(const std::string &key, const std::filesystem::path &output_dir,
+                      const std::vector<std::string> &filenames) {
+    std::filesystem::path entry_directory = cache_directory / key;
+
+    // the bundle is assembled under a unique name and renamed into place so nobody sees a partial entry
+    std::random_device random_device;
+    std::filesystem::path temporary_directory =
+        cache_directory / (key + ".tmp-" + std::to_string(random_device()) + std::to_string(random_device()));
+
+    try {
+        std::filesystem::create_directories(temporary_directory);
+        for (const auto &filename : filenames) {
+            std::filesystem::copy_file(output_dir / filename, temporary_directory / filename);
+        }
+
+        std::error_code rename_error;
+        std::filesystem::rename(temporary_directory, entry_directory, rename_error);
+        if (rename_error) {
+            // somebody else stored the same key first, their bundle is identical so ours isn't needed
+            std::filesystem::remove_all(temporary_directory);
+        } else {
+            global_logger.info("Stored bake cache entry {}", key);
+        }
+    } catch (const std::filesystem::filesystem_error &e) {
+        global_logger.warn("Couldn't store bake cache entry {}: {}", key, e.what());
+        std::error_code cleanup_error;
+        std::filesystem::remove_all(temporary_directory, cleanup_error);
+        return;
+    }
+
+    evict();
+}
+
+void BakeCache::evict() {
+    struct CacheEntry {
+        std::filesystem::path path;
+        std::filesystem::file_time_type last_used;
+        std::uintmax_t size_bytes;
+    };
+
+    std::vector<CacheEntry> entries;
+    std::uintmax_t total_size_bytes = 0;
+
+    try {
+        for (const auto &entry : std::filesystem::directory_iterator(cache_directory)) {
+            if (!entry.is_directory() || entry.path().filename().string().find(".tmp-") != std::string::npos) {
+                continue;
+            }
+
+            std::uintmax_t size_bytes = 0;
+            for (const auto &file : std::filesystem::directory_iterator(entry.path())) {
+                size_bytes += file.file_size();
+            }
+            entries.push_back({entry.path(), entry.last_write_time(), size_bytes});
+            total_size_bytes += size_bytes;
+        }
+    } catch (const std::filesystem::filesystem_error &e) {
+        global_logger.warn("Couldn't scan the bake cache for eviction: {}", e.what());
+        return;
+    }
+
+    std::sort(entries.begin(), entries.end(),
+              [](const CacheEntry &a, const CacheEntry &b) { return a.last_used < b.last_used; });
+
+    for (const auto &entry : entries) {
+        if (total_size_bytes <= max_size_bytes) {
+            break;
+        }
+        std::error_code error;
+        std::filesystem::remove_all(entry.path, error);
+        if (!error) {
+            total_size_bytes -= entry.size_bytes;
+            global_logger.info("Evicted bake cache entry {}", entry.path.filename().string());
+        }
+    }
+}
@@ -0,0 +1,80 @@
+#ifndef BAKE_CACHE_HPP
+#define BAKE_CACHE_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief A non cryptographic 128 bit content hash, made of two 64 bit FNV-1a hashes with different offset bases.
+ *
+ * Good enough to tell apart bake inputs, not meant to resist anyone crafting collisions on purpose.
+ */
+class ContentHash {
+  public:
+    void update(std::string_view data);
+    void update(const std::vector<uint8_t> &data);
+    /// mixes in the length first so that consecutive updates can't run into each other
+    void update_field(std::string_view data);
+    std::string hex_digest() const;
+
+  private:
+    uint64_t low = 0xcbf29ce484222325ULL;
+    uint64_t high = 0x84222325cbf29ce4ULL;
+};
+
+/**
+ * @class BakeCache
+ * @brief A content addressed cache of finished atlas bundles shared through a plain directory.
+ *
+ * The directory can be local or a network mount shared by several machines, there is no service involved. Every
+ * entry is a subdirectory named after the bake key holding the files of one bundle. Entries are published by
+ * renaming a finished temporary directory so a reader never sees a half written one, and the modification time of an
+ * entry is bumped every time it is used so that eviction can drop the least recently used ones first.
+ */
+class BakeCache {
+  public:
+    /**
+     * @param cache_directory The shared directory, created if needed.
+     * @param max_size_bytes Entries are evicted, least recently used first, until the cache is at most this big.
+     */
+    BakeCache(const std::filesystem::path &cache_directory, std::uintmax_t max_size_bytes);
+
+    /**
+     * @brief Places the files of the bundle with the given key into `output_dir`.
+     *
+     * Files are hard linked when possible and copied otherwise, anything already at the destination is replaced. An
+     * entry that is missing one of its files, for example because it was damaged on a shared mount, is removed from
+     * the cache and counts as a miss.
+     *
+     * @param list_bundle_filenames Lists the files a complete bundle in the given directory consists of, it may throw
+     * if the bundle can't be read.
+     * @return true on a hit, false if there is no usable entry for the key.
+     */
+    bool fetch(const std::string &key, const std::filesystem::path &output_dir,
+               const std::function<std::vector<std::string>(const std::filesystem::path &)> &list_bundle_filenames);
+
+    /**
+     * @brief Copies a finished bundle into the cache under the given key and then evicts down to the size limit.
+     *
+     * @param key The bake key of the bundle.
+     * @param output_dir The directory the bundle was written to.
+     * @param filenames The names of the bundle's files within `output_dir`.
+     */
+    void store(const std::string &key, const std::filesystem::path &output_dir,
+               const std::vector<std::string> &filenames);
+
+    /**
+     * @brief Removes the least recently used entries until the cache fits in `max_size_bytes`.
+     */
+    void evict();
+
+  private:
+    std::filesystem::path cache_directory;
+    std::uintmax_t max_size_bytes;
+};
+
+#endif // BAKE_CACHE_HPP
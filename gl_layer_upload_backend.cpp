@@ -0,0 +1,43 @@
+#include "gl_layer_upload_backend.hpp"
+
+GLLayerUploadBackend::GLLayerUploadBackend(GLuint texture_array_gl_id, GLenum texture_array_unit,
+                                           GLenum pixel_format, GLenum indirection_table_unit)
+    : texture_array_gl_id(texture_array_gl_id), texture_array_unit(texture_array_unit), pixel_format(pixel_format),
+      indirection_table_unit(indirection_table_unit) {}
+
+GLLayerUploadBackend::~GLLayerUploadBackend() {
+    if (indirection_table_gl_id != 0) {
+        glDeleteTextures(1, &indirection_table_gl_id);
+    }
+}
+
+bool GLLayerUploadBackend::upload_layer(int slot, int width, int height, const uint8_t *pixels) {
+    // errors left over from earlier calls would otherwise be blamed on this upload
+    while (glGetError() != GL_NO_ERROR) {
+    }
+
+    glActiveTexture(texture_array_unit);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture_array_gl_id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, slot, width, height, 1, pixel_format, GL_UNSIGNED_BYTE, pixels);
+    GLenum error = glGetError();
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glActiveTexture(GL_TEXTURE0);
+    return error == GL_NO_ERROR;
+}
+
+void GLLayerUploadBackend::upload_indirection_table(const std::vector<int> &slot_of_container) {
+    glActiveTexture(indirection_table_unit);
+    if (indirection_table_gl_id == 0) {
+        glGenTextures(1, &indirection_table_gl_id);
+    }
+    glBindTexture(GL_TEXTURE_1D, indirection_table_gl_id);
+    glTexImage1D(GL_TEXTURE_1D, 0, GL_R32I, static_cast<GLsizei>(slot_of_container.size()), 0, GL_RED_INTEGER, GL_INT,
+                 slot_of_container.data());
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+GLuint GLLayerUploadBackend::get_indirection_table_gl_id() const { return indirection_table_gl_id; }
@@ -0,0 +1,36 @@
+#ifndef GL_LAYER_UPLOAD_BACKEND_HPP
+#define GL_LAYER_UPLOAD_BACKEND_HPP
+
+#include "layer_residency.hpp"
+
+#include <glad/glad.h>
+
+/**
+ * @brief Uploads layers into a gl texture array and the indirection table into a `GL_R32I` 1d texture.
+ */
+class GLLayerUploadBackend : public LayerUploadBackend {
+  public:
+    /**
+     * @param texture_array_gl_id The texture array with one layer per slot, it is not owned by the backend.
+     * @param texture_array_unit The texture unit the texture array is bound to.
+     * @param pixel_format The gl format of the layer pixels.
+     * @param indirection_table_unit The texture unit to bind the indirection table to.
+     */
+    GLLayerUploadBackend(GLuint texture_array_gl_id, GLenum texture_array_unit, GLenum pixel_format,
+                         GLenum indirection_table_unit);
+    ~GLLayerUploadBackend() override;
+
+    bool upload_layer(int slot, int width, int height, const uint8_t *pixels) override;
+    void upload_indirection_table(const std::vector<int> &slot_of_container) override;
+
+    GLuint get_indirection_table_gl_id() const;
+
+  private:
+    GLuint texture_array_gl_id;
+    GLenum texture_array_unit;
+    GLenum pixel_format;
+    GLenum indirection_table_unit;
+    GLuint indirection_table_gl_id = 0;
+};
+
+#endif // GL_LAYER_UPLOAD_BACKEND_HPP
@@ -0,0 +1,180 @@
+#include "image_loading_pipeline.hpp"
+#include "packing_search.hpp"
+
+#include <stb_image.h>
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <fstream>
+#include <thread>
+
+struct EncodedImage {
+    size_t index;
+    std::vector<uint8_t> bytes;
+};
+
+std::vector<uint8_t> read_file_bytes(const std::string &path) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) {
+        return {};
+    }
+    std::streamsize size = file.tellg();
+    file.seekg(0, std::ios::beg);
+
+    std::vector<uint8_t> bytes(static_cast<size_t>(std::max<std::streamsize>(size, 0)));
+    if (!file.read(reinterpret_cast<char *>(bytes.data()), size)) {
+        return {};
+    }
+    return bytes;
+}
+
+/**
+ * @brief The queues and counters of one call to ImageLoadingPool::load_images.
+ *
+ * Shared with the threads, so a batch abandoned because the callback threw stays alive until the last thread is done
+ * with it.
+ */
+struct ImageLoadingPool::Batch {
+    Batch(std::vector<std::string> paths, int desired_channels, const ImageLoadingPipelineSettings &settings,
+          unsigned int num_readers, unsigned int num_decoders)
+        : paths(std::move(paths)), desired_channels(desired_channels), encoded_images(settings.max_queued_files),
+          loaded_images(settings.max_queued_images), num_active_readers(num_readers),
+          num_active_decoders(num_decoders) {}
+
+    std::vector<std::string> paths;
+    int desired_channels;
+    BoundedQueue<EncodedImage> encoded_images;
+    BoundedQueue<LoadedImage> loaded_images;
+
+    // the last thread out of each stage closes the queue it feeds so the next stage knows when to stop
+    std::atomic<size_t> next_path_index = 0;
+    std::atomic<unsigned int> num_active_readers;
+    std::atomic<unsigned int> num_active_decoders;
+};
+
+ImageLoadingPool::ImageLoadingPool(const ImageLoadingPipelineSettings &settings)
+    : settings(settings), num_readers(std::max(1u, settings.num_reader_threads)),
+      num_decoders(settings.num_decoder_threads != 0 ? settings.num_decoder_threads
+                                                     : std::max(1u, std::thread::hardware_concurrency())) {
+    for (unsigned int r = 0; r < num_readers; ++r) {
+        threads.emplace_back([this] { run_reader(); });
+    }
+    for (unsigned int d = 0; d < num_decoders; ++d) {
+        threads.emplace_back([this] { run_decoder(); });
+    }
+}
+
+ImageLoadingPool::~ImageLoadingPool() {
+    {
+        std::lock_guard lock(mutex);
+        shutting_down = true;
+    }
+    batch_posted.notify_all();
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
+
+std::shared_ptr<ImageLoadingPool::Batch> ImageLoadingPool::wait_for_batch(uint64_t &last_batch_id) {
+    std::unique_lock lock(mutex);
+    batch_posted.wait(lock, [&] { return shutting_down || current_batch_id != last_batch_id; });
+    if (shutting_down) {
+        return nullptr;
+    }
+    last_batch_id = current_batch_id;
+    return current_batch;
+}
+
+void ImageLoadingPool::run_reader() {
+    uint64_t last_batch_id = 0;
+    while (std::shared_ptr<Batch> batch = wait_for_batch(last_batch_id)) {
+        for (size_t i = batch->next_path_index++; i < batch->paths.size(); i = batch->next_path_index++) {
+            if (!batch->encoded_images.push({i, read_file_bytes(batch->paths[i])})) {
+                break;
+            }
+        }
+        if (--batch->num_active_readers == 0) {
+            batch->encoded_images.close();
+        }
+    }
+}
+
+void ImageLoadingPool::run_decoder() {
+    uint64_t last_batch_id = 0;
+    while (std::shared_ptr<Batch> batch = wait_for_batch(last_batch_id)) {
+        while (std::optional<EncodedImage> encoded_image = batch->encoded_images.pop()) {
+            LoadedImage loaded_image{encoded_image->index};
+            if (!encoded_image->bytes.empty()) {
+                loaded_image.pixels = {stbi_load_from_memory(encoded_image->bytes.data(),
+                                                             static_cast<int>(encoded_image->bytes.size()),
+                                                             &loaded_image.width, &loaded_image.height,
+                                                             &loaded_image.channels_in_file, batch->desired_channels),
+                                       stbi_image_free};
+            }
+            if (!batch->loaded_images.push(std::move(loaded_image))) {
+                break;
+            }
+        }
+        if (--batch->num_active_decoders == 0) {
+            batch->loaded_images.close();
+        }
+    }
+}
+
+void ImageLoadingPool::load_images(const std::vector<std::string> &paths, int desired_channels,
+                                   const std::function<void(LoadedImage &&)> &on_image_loaded) {
+    if (paths.empty()) {
+        return;
+    }
+
+    std::lock_guard batch_lock(batch_mutex);
+    auto batch = std::make_shared<Batch>(paths, desired_channels, settings, num_readers, num_decoders);
+    {
+        std::lock_guard lock(mutex);
+        current_batch = batch;
+        current_batch_id++;
+    }
+    batch_posted.notify_all();
+
+    // every thread of the pool takes part in the batch, so it is only finished once each of them has been through it
+    // and a thread can't miss it for the next one. If the callback throws the queues are closed, which sends the
+    // threads back to waiting as soon as they are done with what they hold
+    try {
+        while (std::optional<LoadedImage> loaded_image = batch->loaded_images.pop()) {
+            on_image_loaded(std::move(*loaded_image));
+        }
+    } catch (...) {
+        batch->encoded_images.close();
+        batch->loaded_images.close();
+        throw;
+    }
+}
+
+void load_images(const std::vector<std::string> &paths, int desired_channels,
+                 const std::function<void(LoadedImage &&)> &on_image_loaded,
+                 const ImageLoadingPipelineSettings &settings) {
+    if (paths.empty()) {
+        return;
+    }
+
+    // a pool just for this call, with no more threads than there are images
+    ImageLoadingPipelineSettings call_settings = settings;
+    unsigned int num_images = static_cast<unsigned int>(std::min<size_t>(paths.size(), UINT_MAX));
+    call_settings.num_reader_threads = std::clamp<unsigned int>(settings.num_reader_threads, 1, num_images);
+    unsigned int num_decoders = settings.num_decoder_threads != 0 ? settings.num_decoder_threads
+                                                                  : std::max(1u, std::thread::hardware_concurrency());
+    call_settings.num_decoder_threads = std::clamp<unsigned int>(num_decoders, 1, num_images);
+
+    ImageLoadingPool image_loading_pool(call_settings);
+    image_loading_pool.load_images(paths, desired_channels, on_image_loaded);
+}
+
+std::vector<ImageInfo> read_image_infos(const std::vector<std::string> &paths) {
+    std::vector<ImageInfo> image_infos(paths.size());
+    parallel_for_each_index(paths.size(), [&](size_t i) {
+        ImageInfo &info = image_infos[i];
+        info.valid = stbi_info(paths[i].c_str(), &info.width, &info.height, &info.channels_in_file) != 0;
+    });
+    return image_infos;
+}
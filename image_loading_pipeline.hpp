@@ -0,0 +1,188 @@
+#ifndef IMAGE_LOADING_PIPELINE_HPP
+#define IMAGE_LOADING_PIPELINE_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief A fixed capacity multi producer multi consumer queue.
+ *
+ * Pushing blocks while the queue is full and popping blocks while it is empty, which is what keeps the stages of the
+ * image loading pipeline from running arbitrarily far ahead of each other.
+ */
+template <typename T> class BoundedQueue {
+  public:
+    explicit BoundedQueue(size_t capacity) : capacity(capacity == 0 ? 1 : capacity) {}
+
+    /**
+     * @brief Waits for space and pushes the item.
+     *
+     * @return false if the queue was closed, in which case the item is dropped.
+     */
+    bool push(T item) {
+        std::unique_lock lock(mutex);
+        not_full.wait(lock, [&] { return closed || items.size() < capacity; });
+        if (closed) {
+            return false;
+        }
+        items.push_back(std::move(item));
+        not_empty.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief Waits for an item and pops it.
+     *
+     * @return std::nullopt once the queue is closed and everything that was pushed has been popped.
+     */
+    std::optional<T> pop() {
+        std::unique_lock lock(mutex);
+        not_empty.wait(lock, [&] { return closed || !items.empty(); });
+        if (items.empty()) {
+            return std::nullopt;
+        }
+        T item = std::move(items.front());
+        items.pop_front();
+        not_full.notify_one();
+        return item;
+    }
+
+    /**
+     * @brief Stops any further pushes, items already in the queue can still be popped.
+     */
+    void close() {
+        std::lock_guard lock(mutex);
+        closed = true;
+        not_empty.notify_all();
+        not_full.notify_all();
+    }
+
+  private:
+    size_t capacity;
+    bool closed = false;
+    std::deque<T> items;
+    std::mutex mutex;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+};
+
+struct ImageLoadingPipelineSettings {
+    /// threads reading files into memory, these mostly wait on the disk so there can be more of them than cores
+    unsigned int num_reader_threads = 4;
+    /// threads decoding images, zero uses std::thread::hardware_concurrency()
+    unsigned int num_decoder_threads = 0;
+    /// how many read but not yet decoded files may be held in memory
+    size_t max_queued_files = 16;
+    /// how many decoded but not yet consumed images may be held in memory
+    size_t max_queued_images = 8;
+};
+
+/**
+ * @brief A decoded image, `pixels` is null if the file couldn't be read or decoded.
+ */
+struct LoadedImage {
+    /// the index of the image's path in the list given to load_images
+    size_t index;
+    int width = 0;
+    int height = 0;
+    int channels_in_file = 0;
+    std::unique_ptr<uint8_t[], void (*)(void *)> pixels{nullptr, nullptr};
+};
+
+/**
+ * @brief The reader and decoder threads of the image loading pipeline, started once and reused by every batch.
+ *
+ * Starting the threads costs about as much as loading a small batch, so a caller loading many batches in a row, such
+ * as one per container, creates a pool up front and loads each batch through it. Batches run one at a time, a call to
+ * load_images from another thread waits for the running one to finish.
+ */
+class ImageLoadingPool {
+  public:
+    explicit ImageLoadingPool(const ImageLoadingPipelineSettings &settings = {});
+    /// must not be called while a batch is loading
+    ~ImageLoadingPool();
+    ImageLoadingPool(const ImageLoadingPool &) = delete;
+    ImageLoadingPool &operator=(const ImageLoadingPool &) = delete;
+
+    /**
+     * @brief Loads one batch of images on the threads of the pool, see the free load_images.
+     */
+    void load_images(const std::vector<std::string> &paths, int desired_channels,
+                     const std::function<void(LoadedImage &&)> &on_image_loaded);
+
+  private:
+    struct Batch;
+
+    /** @brief Waits until a batch newer than `last_batch_id` is posted, null once the pool is shutting down. */
+    std::shared_ptr<Batch> wait_for_batch(uint64_t &last_batch_id);
+    void run_reader();
+    void run_decoder();
+
+    ImageLoadingPipelineSettings settings;
+    unsigned int num_readers;
+    unsigned int num_decoders;
+
+    /// held for the whole of a batch, so batches from different threads don't overlap
+    std::mutex batch_mutex;
+
+    /// guards everything below
+    std::mutex mutex;
+    std::condition_variable batch_posted;
+    std::shared_ptr<Batch> current_batch;
+    uint64_t current_batch_id = 0;
+    bool shutting_down = false;
+
+    std::vector<std::thread> threads;
+};
+
+/**
+ * @brief Reads and decodes the images with reader and decoder threads, handing each one to a callback.
+ *
+ * Files are read on the reader threads and decoded from memory on the decoder threads, so disk latency overlaps with
+ * decoding, and the bounded queues between the stages cap how much memory is in flight. The callback runs on the
+ * calling thread, so it can touch non thread safe state such as the GL context, and images arrive in the order they
+ * finish rather than the order of `paths`.
+ *
+ * If the callback throws, the pipeline is shut down and the exception is rethrown.
+ *
+ * The threads only live for this one call, use an ImageLoadingPool to load several batches.
+ *
+ * @param paths The images to load.
+ * @param desired_channels Passed through to stb_image, 0 keeps the channel count of the file.
+ * @param on_image_loaded Called once for every path.
+ * @param settings Thread counts and queue depths.
+ */
+void load_images(const std::vector<std::string> &paths, int desired_channels,
+                 const std::function<void(LoadedImage &&)> &on_image_loaded,
+                 const ImageLoadingPipelineSettings &settings = {});
+
+/**
+ * @brief Reads a whole file into memory.
+ *
+ * @return The bytes of the file, empty if it couldn't be read.
+ */
+std::vector<uint8_t> read_file_bytes(const std::string &path);
+
+struct ImageInfo {
+    bool valid = false;
+    int width = 0;
+    int height = 0;
+    int channels_in_file = 0;
+};
+
+/**
+ * @brief Reads only the headers of the images in parallel, without decoding any pixels.
+ *
+ * @return The info of each image, in the same order as `paths`.
+ */
+std::vector<ImageInfo> read_image_infos(const std::vector<std::string> &paths);
+
+#endif // IMAGE_LOADING_PIPELINE_HPP
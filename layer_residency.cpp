@@ -0,0 +1,150 @@
+#include "layer_residency.hpp"
+#include "sbpt_generated_includes.hpp"
+
+#include <stb_image.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+LayerResidencyManager::LayerResidencyManager(std::vector<CpuLayer> cpu_layers, int num_channels, int num_slots,
+                                             std::unique_ptr<LayerUploadBackend> backend, int max_uploads_per_frame)
+    : cpu_layers(std::move(cpu_layers)), num_channels(num_channels), backend(std::move(backend)),
+      max_uploads_per_frame(max_uploads_per_frame) {
+    size_t num_containers = this->cpu_layers.size();
+    slot_of_container.assign(num_containers, -1);
+    container_of_slot.assign(std::max(num_slots, 0), -1);
+    last_requested_frame.assign(num_containers, -1);
+    priority_of_container.assign(num_containers, 0);
+}
+
+void LayerResidencyManager::request(int container_index, int priority) {
+    if (container_index < 0 || container_index >= get_num_containers()) {
+        throw std::out_of_range("No container with index " + std::to_string(container_index));
+    }
+
+    if (is_requested_this_frame(container_index)) {
+        priority_of_container[container_index] = std::max(priority_of_container[container_index], priority);
+        return;
+    }
+    last_requested_frame[container_index] = frame;
+    priority_of_container[container_index] = priority;
+    containers_requested_this_frame.push_back(container_index);
+}
+
+void LayerResidencyManager::update() {
+    std::vector<int> containers_to_page_in;
+    for (int container_index : containers_requested_this_frame) {
+        if (slot_of_container[container_index] < 0) {
+            containers_to_page_in.push_back(container_index);
+        }
+    }
+    // stable so that equal priorities are paged in in the order they were requested
+    std::stable_sort(containers_to_page_in.begin(), containers_to_page_in.end(),
+                     [&](int a, int b) { return priority_of_container[a] > priority_of_container[b]; });
+
+    int num_uploads = 0;
+    for (int container_index : containers_to_page_in) {
+        if (max_uploads_per_frame > 0 && num_uploads == max_uploads_per_frame) {
+            break;
+        }
+
+        int slot = choose_slot();
+        if (slot < 0) {
+            stats.num_unserved_requests++;
+            continue;
+        }
+        if (page_in(container_index, slot)) {
+            num_uploads++;
+        }
+    }
+
+    if (indirection_table_changed) {
+        backend->upload_indirection_table(slot_of_container);
+        indirection_table_changed = false;
+    }
+
+    containers_requested_this_frame.clear();
+    frame++;
+}
+
+int LayerResidencyManager::choose_slot() const {
+    int best_slot = -1;
+    for (int slot = 0; slot < get_num_slots(); ++slot) {
+        int resident_container_index = container_of_slot[slot];
+        if (resident_container_index < 0) {
+            return slot;
+        }
+
+        // a layer requested this frame may already be drawn from, so it keeps its slot until the next frame
+        if (is_requested_this_frame(resident_container_index)) {
+            continue;
+        }
+
+        // the least recently requested layer goes first, ties go to the lowest slot
+        if (best_slot < 0 ||
+            last_requested_frame[resident_container_index] < last_requested_frame[container_of_slot[best_slot]]) {
+            best_slot = slot;
+        }
+    }
+    return best_slot;
+}
+
+bool LayerResidencyManager::page_in(int container_index, int slot) {
+    const CpuLayer &cpu_layer = cpu_layers[container_index];
+
+    std::unique_ptr<uint8_t[], void (*)(void *)> decoded_pixels{nullptr, stbi_image_free};
+    const uint8_t *pixels = cpu_layer.pixels.data();
+    int width = cpu_layer.width;
+    int height = cpu_layer.height;
+    if (cpu_layer.pixels.empty()) {
+        int channels_in_file;
+        decoded_pixels.reset(stbi_load_from_memory(cpu_layer.encoded.data(), static_cast<int>(cpu_layer.encoded.size()),
+                                                   &width, &height, &channels_in_file, num_channels));
+        pixels = decoded_pixels.get();
+    }
+    if (!pixels) {
+        global_logger.error("Couldn't decode the cpu copy of container {}", container_index);
+        stats.num_failed_uploads++;
+        return false;
+    }
+
+    int evicted_container_index = container_of_slot[slot];
+    if (evicted_container_index >= 0) {
+        slot_of_container[evicted_container_index] = -1;
+        container_of_slot[slot] = -1;
+        indirection_table_changed = true;
+        stats.num_evictions++;
+    }
+
+    // the old layer may already be partly overwritten, so the slot is left free rather than handed back to it
+    if (!backend->upload_layer(slot, width, height, pixels)) {
+        global_logger.error("Couldn't upload container {} into layer {}", container_index, slot);
+        stats.num_failed_uploads++;
+        return false;
+    }
+
+    container_of_slot[slot] = container_index;
+    slot_of_container[container_index] = slot;
+    indirection_table_changed = true;
+    stats.num_uploads++;
+    return true;
+}
+
+bool LayerResidencyManager::is_requested_this_frame(int container_index) const {
+    return last_requested_frame[container_index] == frame;
+}
+
+int LayerResidencyManager::get_slot_of_container(int container_index) const {
+    return slot_of_container.at(container_index);
+}
+
+bool LayerResidencyManager::is_resident(int container_index) const {
+    return get_slot_of_container(container_index) >= 0;
+}
+
+int LayerResidencyManager::get_num_slots() const { return static_cast<int>(container_of_slot.size()); }
+
+int LayerResidencyManager::get_num_containers() const { return static_cast<int>(cpu_layers.size()); }
+
+const LayerResidencyStats &LayerResidencyManager::get_stats() const { return stats; }
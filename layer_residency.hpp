@@ -0,0 +1,125 @@
+#ifndef LAYER_RESIDENCY_HPP
+#define LAYER_RESIDENCY_HPP
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/**
+ * @brief The cpu copy of a container image which is paged into the gpu on demand.
+ */
+struct CpuLayer {
+    int width = 0;
+    int height = 0;
+    /// the png bytes of the layer, decoded every time it's paged in, only used when `pixels` is empty
+    std::vector<uint8_t> encoded;
+    /// the decoded pixels of the layer, faster to page in but takes more memory
+    std::vector<uint8_t> pixels;
+};
+
+/**
+ * @brief Where the residency manager sends its gpu work.
+ *
+ * The gl backend in gl_layer_upload_backend.hpp is used at runtime, the paging and eviction logic doesn't touch gl
+ * otherwise so it can be driven against a mock backend which just records what would have been uploaded.
+ */
+class LayerUploadBackend {
+  public:
+    virtual ~LayerUploadBackend() = default;
+
+    /**
+     * @brief Copies a container image into a slot of the texture array, starting at its top left corner.
+     *
+     * @return false if the upload failed, the slot may then hold part of the new image and part of the old one.
+     */
+    virtual bool upload_layer(int slot, int width, int height, const uint8_t *pixels) = 0;
+
+    /**
+     * @brief Makes the table mapping container indices to slots visible to shaders.
+     *
+     * @param slot_of_container The slot of every container, -1 for the ones that aren't resident.
+     */
+    virtual void upload_indirection_table(const std::vector<int> &slot_of_container) = 0;
+};
+
+struct LayerResidencyStats {
+    size_t num_uploads = 0;
+    size_t num_evictions = 0;
+    /// layers which couldn't be decoded or uploaded, they don't count towards the uploads of a frame
+    size_t num_failed_uploads = 0;
+    /// requests which couldn't be served because every slot held a layer requested in the same frame, the shader
+    /// sees -1 for those containers until a later frame has room for them
+    size_t num_unserved_requests = 0;
+};
+
+/**
+ * @class LayerResidencyManager
+ * @brief Keeps the most needed containers of a texture array in a fixed pool of gpu layer slots.
+ *
+ * Every frame the containers that are about to be drawn are requested, then `update` pages in the ones that aren't
+ * resident yet, highest priority first. A slot is taken from a free slot if there is one, otherwise from the least
+ * recently requested layer, ties going to the lowest slot. A layer requested this frame is never evicted, so when
+ * more containers are requested in one frame than there are slots the lowest priority ones stay out, are counted in
+ * `LayerResidencyStats::num_unserved_requests` and read as -1 in the indirection table. Shaders find the layer of a
+ * container through the indirection table, which is uploaded again whenever it changes.
+ */
+class LayerResidencyManager {
+  public:
+    /**
+     * @param cpu_layers The cpu copy of every container, indexed by container index.
+     * @param num_channels The number of channels of the texture array, compressed layers are decoded to this.
+     * @param num_slots The number of layers in the texture array.
+     * @param backend Receives the uploads.
+     * @param max_uploads_per_frame Caps how many layers one update pages in to avoid hitches, zero is no cap.
+     */
+    LayerResidencyManager(std::vector<CpuLayer> cpu_layers, int num_channels, int num_slots,
+                          std::unique_ptr<LayerUploadBackend> backend, int max_uploads_per_frame = 0);
+
+    /**
+     * @brief Marks a container as needed this frame, requesting it more than once keeps the highest priority.
+     *
+     * @throws std::out_of_range If there is no such container.
+     */
+    void request(int container_index, int priority = 0);
+
+    /**
+     * @brief Pages in the containers requested since the last update and starts the next frame.
+     */
+    void update();
+
+    /**
+     * @return The slot holding the container, or -1 if it isn't resident.
+     */
+    int get_slot_of_container(int container_index) const;
+    bool is_resident(int container_index) const;
+    int get_num_slots() const;
+    int get_num_containers() const;
+    const LayerResidencyStats &get_stats() const;
+
+  private:
+    /// the slot the next paged in container should go in, or -1 if every slot holds a layer requested this frame
+    int choose_slot() const;
+    /// returns false if the layer couldn't be decoded or uploaded, a slot that was overwritten is left free
+    bool page_in(int container_index, int slot);
+    bool is_requested_this_frame(int container_index) const;
+
+    std::vector<CpuLayer> cpu_layers;
+    int num_channels;
+    std::unique_ptr<LayerUploadBackend> backend;
+    int max_uploads_per_frame;
+
+    std::vector<int> slot_of_container;
+    /// the container in each slot, -1 for free slots
+    std::vector<int> container_of_slot;
+    /// the frame each container was last requested in, -1 if it never was
+    std::vector<long long> last_requested_frame;
+    /// the priority each container was last requested with
+    std::vector<int> priority_of_container;
+    std::vector<int> containers_requested_this_frame;
+    long long frame = 0;
+    bool indirection_table_changed = true;
+
+    LayerResidencyStats stats;
+};
+
+#endif // LAYER_RESIDENCY_HPP
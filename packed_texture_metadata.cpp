@@ -0,0 +1,304 @@
+#include "packed_texture_metadata.hpp"
+#include "sbpt_generated_includes.hpp"
+
+#include <cmath>
+#include <fstream>
+#include <nlohmann/json.hpp>
+#include <stdexcept>
+#include <string_view>
+
+namespace {
+
+/// returns false if `field` isn't part of a rect, fractional values are truncated
+bool set_rect_field(SubTextureRecord &record, std::string_view field, double value) {
+    if (field == "x") {
+        record.x = static_cast<int>(value);
+    } else if (field == "y") {
+        record.y = static_cast<int>(value);
+    } else if (field == "width") {
+        record.width = static_cast<int>(value);
+    } else if (field == "height") {
+        record.height = static_cast<int>(value);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief A sax handler which keeps track of the key of every enclosing object, so subclasses can tell where a value is
+ * without building anything.
+ *
+ * When a value arrives, or an object starts or ends, `depth` is the number of objects and arrays around it and
+ * `keys[i]` is the key it sits under at nesting level i. The key strings are reused between entries, so walking a
+ * file doesn't allocate per key once the longest key has been seen.
+ */
+class KeyPathSaxHandler : public nlohmann::json_sax<nlohmann::json> {
+  public:
+    bool null() override { return true; }
+    bool boolean(bool) override { return true; }
+    bool number_integer(number_integer_t value) override {
+        on_number(static_cast<double>(value));
+        return true;
+    }
+    bool number_unsigned(number_unsigned_t value) override {
+        on_number(static_cast<double>(value));
+        return true;
+    }
+    bool number_float(number_float_t value, const string_t &) override {
+        on_number(value);
+        return true;
+    }
+    bool string(string_t &value) override {
+        on_string(value);
+        return true;
+    }
+    bool binary(binary_t &) override { return true; }
+
+    bool start_object(std::size_t) override {
+        on_object_start();
+        push_level();
+        return true;
+    }
+    bool key(string_t &key) override {
+        keys[depth - 1].assign(key);
+        return true;
+    }
+    bool end_object() override {
+        --depth;
+        on_object_end();
+        return true;
+    }
+    bool start_array(std::size_t) override {
+        push_level();
+        return true;
+    }
+    bool end_array() override {
+        --depth;
+        return true;
+    }
+
+    bool parse_error(std::size_t, const std::string &, const nlohmann::detail::exception &e) override {
+        error_message = e.what();
+        return false;
+    }
+
+    std::string error_message;
+
+  protected:
+    virtual void on_number(double) {}
+    virtual void on_string(const std::string &) {}
+    virtual void on_object_start() {}
+    virtual void on_object_end() {}
+
+    bool key_is(size_t level, std::string_view key) const { return keys[level] == key; }
+
+    /**
+     * @brief Handles {"sub_textures": {name: {x, y, width, height, "sub_textures": {...}}}} nested to any depth inside
+     * the object at `owner_depth`, flattening it into `records` with every parent before its children.
+     *
+     * Call it whenever an object starts inside the owner, it returns true if the object is a sub-texture.
+     */
+    bool start_sub_texture(std::vector<SubTextureRecord> &records, size_t owner_depth) {
+        // a sub-texture sits two levels below its parent, under the parent's "sub_textures" key
+        size_t parent_depth = open_sub_textures.empty() ? owner_depth : open_sub_textures.back().depth;
+        if (depth != parent_depth + 2 || !key_is(depth - 2, "sub_textures")) {
+            return false;
+        }
+        int parent = open_sub_textures.empty() ? -1 : open_sub_textures.back().index;
+        records.push_back({keys[depth - 1], 0, 0, 0, 0, parent});
+        open_sub_textures.push_back({depth, static_cast<int>(records.size()) - 1});
+        return true;
+    }
+
+    void end_sub_texture() {
+        if (!open_sub_textures.empty() && open_sub_textures.back().depth == depth) {
+            open_sub_textures.pop_back();
+        }
+    }
+
+    /// returns the innermost open sub-texture if the number was one of its rect fields, nullptr otherwise
+    SubTextureRecord *set_sub_texture_field(std::vector<SubTextureRecord> &records, double value) {
+        if (open_sub_textures.empty() || depth != open_sub_textures.back().depth + 1) {
+            return nullptr;
+        }
+        SubTextureRecord &record = records[open_sub_textures.back().index];
+        return set_rect_field(record, keys[depth - 1], value) ? &record : nullptr;
+    }
+
+    size_t depth = 0;
+    std::vector<std::string> keys;
+
+  private:
+    struct OpenSubTexture {
+        size_t depth;
+        int index;
+    };
+    /// the sub-textures the parser is inside of, innermost last
+    std::vector<OpenSubTexture> open_sub_textures;
+
+    void push_level() {
+        if (keys.size() <= depth) {
+            keys.emplace_back();
+        }
+        // array elements have no key, clearing it keeps a stale one from matching
+        keys[depth].clear();
+        ++depth;
+    }
+};
+
+/**
+ * @brief Reads {"formats": {format: {...}}, "sub_textures": {path: {..., "sub_textures": {name: rect}}}}, where a rect
+ * may have "sub_textures" of its own.
+ */
+class PackedTexturesSaxHandler : public KeyPathSaxHandler {
+  public:
+    PackedTexturesSaxHandler(const std::function<void(const PackedFormatRecord &)> &on_format,
+                             const std::function<void(const PackedTextureRecord &)> &on_texture)
+        : on_format(on_format), on_texture(on_texture) {}
+
+  protected:
+    void on_object_start() override {
+        if (depth == 2 && key_is(0, "formats")) {
+            format_record.format.assign(keys[1]);
+            format_record.container_side_length = 0;
+            format_record.num_containers = 0;
+        } else if (depth == 2 && key_is(0, "sub_textures")) {
+            texture_record.path.assign(keys[1]);
+            texture_record.format.assign("rgba8");
+            texture_record.container_index = 0;
+            texture_record.x = texture_record.y = texture_record.width = texture_record.height = 0;
+            texture_record.scale = 1.0f;
+            texture_record.source_width = texture_record.source_height = 0;
+            texture_record.sub_textures.clear();
+        } else if (depth >= 4 && key_is(0, "sub_textures")) {
+            start_sub_texture(texture_record.sub_textures, 2);
+        }
+    }
+
+    void on_object_end() override {
+        end_sub_texture();
+        if (depth == 2 && key_is(0, "formats")) {
+            on_format(format_record);
+        } else if (depth == 2 && key_is(0, "sub_textures")) {
+            on_texture(texture_record);
+        }
+    }
+
+    void on_number(double value) override {
+        if (depth == 3 && key_is(0, "formats")) {
+            if (key_is(2, "container_side_length")) {
+                format_record.container_side_length = static_cast<int>(value);
+            } else if (key_is(2, "num_containers")) {
+                format_record.num_containers = static_cast<int>(value);
+            }
+        } else if (depth == 3 && key_is(0, "sub_textures")) {
+            set_texture_field(keys[2], value);
+        } else if (key_is(0, "sub_textures")) {
+            set_sub_texture_field(texture_record.sub_textures, value);
+        }
+    }
+
+    void on_string(const std::string &value) override {
+        if (depth == 3 && key_is(0, "sub_textures") && key_is(2, "format")) {
+            texture_record.format.assign(value);
+        }
+    }
+
+  private:
+    void set_texture_field(std::string_view field, double value) {
+        if (field == "container_index") {
+            texture_record.container_index = static_cast<int>(value);
+        } else if (field == "scale") {
+            texture_record.scale = static_cast<float>(value);
+        } else if (field == "source_width") {
+            texture_record.source_width = static_cast<int>(value);
+        } else if (field == "source_height") {
+            texture_record.source_height = static_cast<int>(value);
+        } else if (field == "x") {
+            texture_record.x = static_cast<int>(value);
+        } else if (field == "y") {
+            texture_record.y = static_cast<int>(value);
+        } else if (field == "width") {
+            texture_record.width = static_cast<int>(value);
+        } else if (field == "height") {
+            texture_record.height = static_cast<int>(value);
+        }
+    }
+
+    const std::function<void(const PackedFormatRecord &)> &on_format;
+    const std::function<void(const PackedTextureRecord &)> &on_texture;
+    PackedFormatRecord format_record;
+    PackedTextureRecord texture_record;
+};
+
+/**
+ * @brief Reads {"priority": n, "sub_textures": {name: rect}}, where a rect may have "sub_textures" of its own.
+ *
+ * Only x, y, width and height of a rect are kept, they are truncated to whole pixels with a warning.
+ */
+class SidecarSaxHandler : public KeyPathSaxHandler {
+  public:
+    SidecarSaxHandler(SidecarRecord &sidecar, const std::filesystem::path &file_path)
+        : sidecar(sidecar), file_path(file_path) {}
+
+  protected:
+    void on_object_start() override {
+        if (depth >= 2) {
+            start_sub_texture(sidecar.sub_textures, 0);
+        }
+    }
+
+    void on_object_end() override { end_sub_texture(); }
+
+    void on_number(double value) override {
+        if (depth == 1 && key_is(0, "priority")) {
+            sidecar.priority = static_cast<int>(value);
+        } else if (SubTextureRecord *record = set_sub_texture_field(sidecar.sub_textures, value)) {
+            // rects are stored in whole pixels, so the fraction is lost
+            if (value != std::trunc(value)) {
+                global_logger.warn("The {} of sub-texture {} in {} is {}, which isn't a whole number of pixels, it was "
+                                   "truncated to {}",
+                                   keys[depth - 1], record->name, file_path.string(), value, static_cast<int>(value));
+            }
+        }
+    }
+
+  private:
+    SidecarRecord &sidecar;
+    const std::filesystem::path &file_path;
+};
+
+void sax_parse_file(std::ifstream &file, const std::filesystem::path &file_path, KeyPathSaxHandler &handler) {
+    if (!nlohmann::json::sax_parse(file, &handler)) {
+        throw std::runtime_error("Couldn't parse " + file_path.string() + ": " + handler.error_message);
+    }
+}
+
+} // namespace
+
+void read_packed_textures_metadata(const std::filesystem::path &file_path,
+                                   const std::function<void(const PackedFormatRecord &)> &on_format,
+                                   const std::function<void(const PackedTextureRecord &)> &on_texture) {
+    std::ifstream file(file_path, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Couldn't open " + file_path.string());
+    }
+
+    PackedTexturesSaxHandler handler(on_format, on_texture);
+    sax_parse_file(file, file_path, handler);
+}
+
+bool read_sidecar_metadata(const std::filesystem::path &file_path, SidecarRecord &sidecar) {
+    sidecar.priority.reset();
+    sidecar.sub_textures.clear();
+
+    std::ifstream file(file_path, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    SidecarSaxHandler handler(sidecar, file_path);
+    sax_parse_file(file, file_path, handler);
+    return true;
+}
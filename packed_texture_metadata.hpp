@@ -0,0 +1,80 @@
+#ifndef PACKED_TEXTURE_METADATA_HPP
+#define PACKED_TEXTURE_METADATA_HPP
+
+#include <filesystem>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+/**
+ * @brief A named rect inside a texture, sub-textures can hold sub-textures of their own to any depth.
+ *
+ * In a sidecar json a rect is relative to the top left of its parent, which is the texture itself for the outermost
+ * ones. In packed_textures.json every rect is relative to the top left of the container.
+ */
+struct SubTextureRecord {
+    std::string name;
+    int x, y, width, height;
+    /// the index of the enclosing sub-texture among the records of the same texture, which always comes first, -1
+    /// when the sub-texture is directly inside the texture
+    int parent = -1;
+};
+
+/**
+ * @brief One entry of "formats" in packed_textures.json, describing the texture array of a format.
+ */
+struct PackedFormatRecord {
+    std::string format;
+    int container_side_length = 0;
+    int num_containers = 0;
+};
+
+/**
+ * @brief One entry of "sub_textures" in packed_textures.json, describing where a texture was packed.
+ */
+struct PackedTextureRecord {
+    std::string path;
+    /// metadata written before formats were recorded only has rgba8 textures and leaves this out
+    std::string format = "rgba8";
+    int container_index = 0;
+    int x = 0, y = 0, width = 0, height = 0;
+    float scale = 1.0f;
+    int source_width = 0, source_height = 0;
+    /// flattened, every parent comes before its children
+    std::vector<SubTextureRecord> sub_textures;
+};
+
+/**
+ * @brief What the sidecar json next to a texture can say about it.
+ */
+struct SidecarRecord {
+    std::optional<int> priority;
+    /// flattened, every parent comes before its children
+    std::vector<SubTextureRecord> sub_textures;
+};
+
+/**
+ * @brief Streams packed_textures.json, handing over every format and texture as soon as it has been read.
+ *
+ * No json document is built. The records passed to the callbacks are reused for the next entry, so anything needed
+ * after a callback returns has to be copied out. Unknown keys are skipped.
+ *
+ * @throws std::runtime_error If the file can't be opened or isn't valid json.
+ */
+void read_packed_textures_metadata(const std::filesystem::path &file_path,
+                                   const std::function<void(const PackedFormatRecord &)> &on_format,
+                                   const std::function<void(const PackedTextureRecord &)> &on_texture);
+
+/**
+ * @brief Streams the sidecar json of a texture into `sidecar`, which is cleared first so it can be reused.
+ *
+ * Only "priority" and the x, y, width, height and "sub_textures" of every sub-texture are read, anything else is
+ * skipped. Fractional rect values are truncated to whole pixels and logged.
+ *
+ * @return false if there is no sidecar at `file_path`.
+ * @throws std::runtime_error If the sidecar isn't valid json.
+ */
+bool read_sidecar_metadata(const std::filesystem::path &file_path, SidecarRecord &sidecar);
+
+#endif // PACKED_TEXTURE_METADATA_HPP
@@ -0,0 +1,184 @@
+#include "packing_search.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <numeric>
+#include <thread>
+
+std::string to_string(BlockOrdering ordering) {
+    switch (ordering) {
+    case BlockOrdering::min_side:
+        return "min_side";
+    case BlockOrdering::area:
+        return "area";
+    case BlockOrdering::max_side:
+        return "max_side";
+    case BlockOrdering::perimeter:
+        return "perimeter";
+    case BlockOrdering::height:
+        return "height";
+    case BlockOrdering::width:
+        return "width";
+    }
+    return "unknown";
+}
+
+std::string to_string(SplitRule split_rule) {
+    switch (split_rule) {
+    case SplitRule::split_horizontally:
+        return "split_horizontally";
+    case SplitRule::split_vertically:
+        return "split_vertically";
+    case SplitRule::shorter_leftover_axis:
+        return "shorter_leftover_axis";
+    case SplitRule::longer_leftover_axis:
+        return "longer_leftover_axis";
+    }
+    return "unknown";
+}
+
+long long ordering_key(int w, int h, BlockOrdering ordering) {
+    switch (ordering) {
+    case BlockOrdering::min_side:
+        return std::min(w, h);
+    case BlockOrdering::area:
+        return static_cast<long long>(w) * h;
+    case BlockOrdering::max_side:
+        return std::max(w, h);
+    case BlockOrdering::perimeter:
+        return 2LL * (w + h);
+    case BlockOrdering::height:
+        return h;
+    case BlockOrdering::width:
+        return w;
+    }
+    return 0;
+}
+
+PackingResult pack_blocks(const BlockSizes &blocks, int container_size, const PackingStrategy &strategy) {
+    PackingResult result;
+    result.strategy = strategy;
+    result.placements.resize(blocks.size());
+
+    std::vector<long long> ordering_keys(blocks.size());
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        ordering_keys[i] = ordering_key(blocks.widths[i], blocks.heights[i], strategy.ordering);
+    }
+
+    // stable so that equal blocks keep their input order and the result only depends on the input
+    result.packing_order.resize(blocks.size());
+    std::iota(result.packing_order.begin(), result.packing_order.end(), 0);
+    std::stable_sort(result.packing_order.begin(), result.packing_order.end(),
+                     [&](size_t a, size_t b) { return ordering_keys[a] > ordering_keys[b]; });
+
+    long long packed_area = 0;
+    int last_container_used_w = 0;
+    int last_container_used_h = 0;
+
+    for (size_t block_index : result.packing_order) {
+        Block block(blocks.widths[block_index], blocks.heights[block_index]);
+
+        if (block.w > container_size || block.h > container_size) {
+            result.num_unplaced_blocks++;
+            continue;
+        }
+
+        int container_index = 0;
+        for (; container_index < result.num_containers(); ++container_index) {
+            result.packers[container_index]->fit(block);
+            if (block.packed_placement) {
+                break;
+            }
+        }
+
+        if (!block.packed_placement) {
+            result.packers.push_back(
+                std::make_shared<SplitPacker>(container_size, container_size, strategy.split_rule));
+            result.packers.back()->fit(block);
+            container_index = result.num_containers() - 1;
+            last_container_used_w = 0;
+            last_container_used_h = 0;
+        }
+
+        result.placements[block_index] =
+            BlockPlacement{container_index, block.packed_placement->top_left_x, block.packed_placement->top_left_y};
+        packed_area += static_cast<long long>(block.w) * block.h;
+
+        if (container_index == result.num_containers() - 1) {
+            last_container_used_w = std::max(last_container_used_w, block.packed_placement->top_left_x + block.w);
+            last_container_used_h = std::max(last_container_used_h, block.packed_placement->top_left_y + block.h);
+        }
+    }
+
+    if (result.num_containers() > 0) {
+        long long container_area = static_cast<long long>(container_size) * container_size;
+        long long available_area = container_area * (result.num_containers() - 1) +
+                                   static_cast<long long>(last_container_used_w) * last_container_used_h;
+        result.occupancy = static_cast<double>(packed_area) / static_cast<double>(available_area);
+    }
+
+    return result;
+}
+
+bool is_better_packing(const PackingResult &candidate, const PackingResult &best) {
+    if (candidate.num_unplaced_blocks != best.num_unplaced_blocks) {
+        return candidate.num_unplaced_blocks < best.num_unplaced_blocks;
+    }
+    if (candidate.num_containers() != best.num_containers()) {
+        return candidate.num_containers() < best.num_containers();
+    }
+    return candidate.occupancy > best.occupancy;
+}
+
+void parallel_for_each_index(size_t count, const std::function<void(size_t)> &work) {
+    if (count == 0) {
+        return;
+    }
+
+    std::atomic<size_t> next_index = 0;
+    unsigned int num_workers =
+        std::clamp<unsigned int>(std::thread::hardware_concurrency(), 1, static_cast<unsigned int>(count));
+
+    std::vector<std::thread> workers;
+    for (unsigned int w = 0; w < num_workers; ++w) {
+        workers.emplace_back([&] {
+            for (size_t i = next_index++; i < count; i = next_index++) {
+                work(i);
+            }
+        });
+    }
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
+
+PackingResult search_for_best_packing(const BlockSizes &blocks, int container_size, int num_candidates) {
+    if (num_candidates <= 1) {
+        return pack_blocks(blocks, container_size, PackingStrategy{});
+    }
+
+    // the default strategy comes first so that it is always evaluated and wins every tie. The ordering changes the
+    // packing more than the split rule does, so every ordering is tried with one rule before the next rule is
+    std::vector<PackingStrategy> candidates;
+    for (SplitRule split_rule : {SplitRule::split_horizontally, SplitRule::split_vertically,
+                                 SplitRule::shorter_leftover_axis, SplitRule::longer_leftover_axis}) {
+        for (BlockOrdering ordering : {BlockOrdering::min_side, BlockOrdering::area, BlockOrdering::max_side,
+                                       BlockOrdering::perimeter, BlockOrdering::height, BlockOrdering::width}) {
+            candidates.push_back({ordering, split_rule});
+        }
+    }
+    candidates.resize(std::min(candidates.size(), static_cast<size_t>(num_candidates)));
+
+    std::vector<PackingResult> results(candidates.size());
+    parallel_for_each_index(candidates.size(),
+                            [&](size_t i) { results[i] = pack_blocks(blocks, container_size, candidates[i]); });
+
+    size_t best_index = 0;
+    for (size_t i = 1; i < results.size(); ++i) {
+        if (is_better_packing(results[i], results[best_index])) {
+            best_index = i;
+        }
+    }
+
+    return std::move(results[best_index]);
+}
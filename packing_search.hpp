@@ -0,0 +1,106 @@
+#ifndef PACKING_SEARCH_HPP
+#define PACKING_SEARCH_HPP
+
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "split_packer.hpp"
+
+/**
+ * @brief The order in which blocks are handed to the packers, every ordering is descending.
+ */
+enum class BlockOrdering { min_side, area, max_side, perimeter, height, width };
+
+std::string to_string(BlockOrdering ordering);
+std::string to_string(SplitRule split_rule);
+
+/**
+ * @brief One way of packing a set of blocks, the default is the original greedy pass.
+ */
+struct PackingStrategy {
+    BlockOrdering ordering = BlockOrdering::min_side;
+    SplitRule split_rule = SplitRule::split_horizontally;
+};
+
+/// every block ordering combined with every split rule
+constexpr int num_packing_strategies = 24;
+
+/**
+ * @brief The sizes of the blocks to pack as parallel arrays, block i is widths[i] by heights[i].
+ *
+ * A block's index is its id, everything else known about it lives elsewhere and is looked up by that id, so the
+ * search only ever touches these two arrays.
+ */
+struct BlockSizes {
+    std::vector<int> widths;
+    std::vector<int> heights;
+
+    size_t size() const { return widths.size(); }
+    void reserve(size_t n) {
+        widths.reserve(n);
+        heights.reserve(n);
+    }
+    void push_back(int width, int height) {
+        widths.push_back(width);
+        heights.push_back(height);
+    }
+};
+
+struct BlockPlacement {
+    int container_index;
+    int top_left_x;
+    int top_left_y;
+};
+
+/**
+ * @brief The outcome of packing a set of blocks with a single strategy.
+ */
+struct PackingResult {
+    PackingStrategy strategy;
+    /// one packer per container that was created, in container order
+    std::vector<std::shared_ptr<SplitPacker>> packers;
+    /// indexed the same as the blocks that were packed, std::nullopt for blocks that didn't fit in any container
+    std::vector<std::optional<BlockPlacement>> placements;
+    /// the indices of the blocks in the order they were packed
+    std::vector<size_t> packing_order;
+    int num_unplaced_blocks = 0;
+    /// packed area divided by the area of every full container plus the used extent of the last one
+    double occupancy = 0.0;
+
+    int num_containers() const { return static_cast<int>(packers.size()); }
+};
+
+/**
+ * @brief Packs the blocks greedily, each block goes into the first container it fits in, or a new one.
+ *
+ * The blocks themselves are not modified, so this can run on many threads over the same blocks.
+ */
+PackingResult pack_blocks(const BlockSizes &blocks, int container_size, const PackingStrategy &strategy);
+
+/**
+ * @brief Packs the blocks with every ordering and split rule on worker threads and keeps the best result.
+ *
+ * The best result has the fewest unplaced blocks, then the fewest containers, then the highest occupancy, and any
+ * remaining tie goes to the strategy that comes first in the candidate list. That makes the selection deterministic
+ * for a given set of evaluated strategies.
+ *
+ * The candidates are always evaluated in the same order starting with the default strategy, and only the first
+ * `num_candidates` of them are tried, so the result only depends on the blocks and the arguments, never on how fast
+ * the machine is. Every block ordering comes with the first split rule before any of them comes with the second, so
+ * (min_side, split_horizontally), (area, split_horizontally), (max_side, split_horizontally) and so on, which makes
+ * even a small `num_candidates` try distinct orderings.
+ *
+ * @param num_candidates How many strategies to try, anything below one tries only the default strategy and anything
+ * above `num_packing_strategies` tries all of them.
+ */
+PackingResult search_for_best_packing(const BlockSizes &blocks, int container_size, int num_candidates);
+
+/**
+ * @brief Runs `work(i)` for every i in [0, count) on up to `std::thread::hardware_concurrency()` threads.
+ */
+void parallel_for_each_index(size_t count, const std::function<void(size_t)> &work);
+
+#endif // PACKING_SEARCH_HPP
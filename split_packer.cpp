@@ -2,25 +2,42 @@
 
 PackedRectNode::PackedRectNode(int x, int y, int w, int h) : top_left_x(x), top_left_y(y), w(w), h(h) {}
 Block::Block(int w, int h) : w(w), h(h) {}
-SplitPacker::SplitPacker(int width, int height) { root = std::make_shared<PackedRectNode>(0, 0, width, height); }
-
-std::shared_ptr<PackedRectNode> SplitPacker::find_node_with_enough_space_rec(std::shared_ptr<PackedRectNode> node,
-                                                                             int width, int height) {
-    if (!node)
-        return nullptr;
-
-    if (node->used) {
-        auto right_node = find_node_with_enough_space_rec(node->right, width, height);
-        return right_node ? right_node : find_node_with_enough_space_rec(node->left, width, height);
-    } else if (width <= node->w && height <= node->h) {
-        node->used = true;
-        node->right =
-            std::make_shared<PackedRectNode>(node->top_left_x + width, node->top_left_y, node->w - width, height);
-        node->left =
-            std::make_shared<PackedRectNode>(node->top_left_x, node->top_left_y + height, node->w, node->h - height);
-        return node;
+SplitPacker::SplitPacker(int width, int height, SplitRule split_rule) : split_rule(split_rule) {
+    nodes.emplace_back(0, 0, width, height);
+}
+
+int SplitPacker::find_node_with_enough_space_rec(int node_index, int width, int height) {
+    if (node_index < 0)
+        return -1;
+
+    // copied because splitting appends to nodes, which can move every node
+    PackedRectNode node = nodes[node_index];
+
+    if (node.used) {
+        int right_node_index = find_node_with_enough_space_rec(node.right, width, height);
+        return right_node_index >= 0 ? right_node_index : find_node_with_enough_space_rec(node.left, width, height);
+    } else if (width <= node.w && height <= node.h) {
+        int leftover_w = node.w - width;
+        int leftover_h = node.h - height;
+        bool split_horizontally = split_rule == SplitRule::split_horizontally ||
+                                  (split_rule == SplitRule::shorter_leftover_axis && leftover_w <= leftover_h) ||
+                                  (split_rule == SplitRule::longer_leftover_axis && leftover_w > leftover_h);
+
+        int right_node_index = static_cast<int>(nodes.size());
+        if (split_horizontally) {
+            nodes.emplace_back(node.top_left_x + width, node.top_left_y, leftover_w, height);
+            nodes.emplace_back(node.top_left_x, node.top_left_y + height, node.w, leftover_h);
+        } else {
+            nodes.emplace_back(node.top_left_x + width, node.top_left_y, leftover_w, node.h);
+            nodes.emplace_back(node.top_left_x, node.top_left_y + height, width, leftover_h);
+        }
+
+        nodes[node_index].used = true;
+        nodes[node_index].right = right_node_index;
+        nodes[node_index].left = right_node_index + 1;
+        return node_index;
     } else {
-        return nullptr;
+        return -1;
     }
 }
 
@@ -31,10 +48,12 @@ void SplitPacker::fit(std::vector<Block> &blocks) {
 }
 
 void SplitPacker::fit(Block &block) {
-    auto node = find_node_with_enough_space_rec(root, block.w, block.h);
-    if (node) {
-        block.packed_placement = *node;
+    int node_index = find_node_with_enough_space_rec(0, block.w, block.h);
+    if (node_index >= 0) {
+        block.packed_placement = nodes[node_index];
     } else {
         block.packed_placement = std::nullopt;
     }
 }
+
+const std::vector<PackedRectNode> &SplitPacker::get_nodes() const { return nodes; }
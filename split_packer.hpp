@@ -8,8 +8,9 @@
 struct PackedRectNode {
     int top_left_x, top_left_y, w, h;
     bool used = false;
-    std::shared_ptr<PackedRectNode> left = nullptr;
-    std::shared_ptr<PackedRectNode> right = nullptr;
+    /// the indices of the children in the node pool of the packer that owns this node, -1 when there is none
+    int left = -1;
+    int right = -1;
     PackedRectNode(int x, int y, int w, int h);
 };
 
@@ -20,16 +21,36 @@ class Block {
     Block(int w, int h);
 };
 
+/**
+ * @brief How the leftover space of a node is divided after a block is placed in its top left corner.
+ */
+enum class SplitRule {
+    /// the space below the block spans the whole width of the node, this is the original behavior
+    split_horizontally,
+    /// the space to the right of the block spans the whole height of the node
+    split_vertically,
+    /// split along the axis with less leftover space, keeping the bigger leftover rectangle whole
+    shorter_leftover_axis,
+    /// split along the axis with more leftover space
+    longer_leftover_axis,
+};
+
 class SplitPacker {
   public:
-    SplitPacker(int width, int height);
+    SplitPacker(int width, int height, SplitRule split_rule = SplitRule::split_horizontally);
     void fit(std::vector<Block> &blocks);
     void fit(Block &block);
 
+    /**
+     * @brief Every node of the tree, the root is the first one and the unused ones are the remaining free space.
+     */
+    const std::vector<PackedRectNode> &get_nodes() const;
+
   private:
-    std::shared_ptr<PackedRectNode> root;
-    std::shared_ptr<PackedRectNode> find_node_with_enough_space_rec(std::shared_ptr<PackedRectNode> root, int width,
-                                                                    int height);
+    SplitRule split_rule;
+    /// the nodes refer to their children by index, so the whole tree lives in a single growing allocation
+    std::vector<PackedRectNode> nodes;
+    int find_node_with_enough_space_rec(int node_index, int width, int height);
 };
 
 #endif // SPLIT_PACKER_HPP
@@ -0,0 +1,32 @@
+#ifndef TESTS_CHECK_HPP
+#define TESTS_CHECK_HPP
+
+#include <cstdio>
+
+/// the number of CHECKs that failed so far, main returns non-zero when it isn't zero
+inline int num_failed_checks = 0;
+
+/**
+ * @brief Reports a failed condition and carries on, unlike assert it isn't compiled out by NDEBUG.
+ */
+#define CHECK(condition)                                                                                               \
+    do {                                                                                                               \
+        if (!(condition)) {                                                                                            \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition);                         \
+            num_failed_checks++;                                                                                       \
+        }                                                                                                              \
+    } while (false)
+
+/**
+ * @brief Prints the outcome of a test program and gives the exit code main should return.
+ */
+inline int report_checks(const char *test_name) {
+    if (num_failed_checks > 0) {
+        std::fprintf(stderr, "%s: %d checks failed\n", test_name, num_failed_checks);
+        return 1;
+    }
+    std::printf("%s passed\n", test_name);
+    return 0;
+}
+
+#endif // TESTS_CHECK_HPP
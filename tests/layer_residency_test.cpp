@@ -0,0 +1,249 @@
+// Links against layer_residency.cpp, stb_image and the logger only, the gl backend lives in its own file:
+//   g++ -std=c++20 -I.. layer_residency_test.cpp ../layer_residency.cpp <stb_image and logger sources> && ./a.out
+// It exits with 1 if any check failed.
+
+#include "../layer_residency.hpp"
+#include "check.hpp"
+
+#include <memory>
+#include <stdexcept>
+
+/**
+ * @brief Records what would have been uploaded instead of touching gl.
+ *
+ * Every test layer is a single pixel whose bytes are its container index, so an upload tells which container went
+ * into which slot.
+ */
+class RecordingLayerUploadBackend : public LayerUploadBackend {
+  public:
+    struct LayerUpload {
+        int slot;
+        int container_index;
+    };
+
+    bool upload_layer(int slot, int, int, const uint8_t *pixels) override {
+        if (num_uploads_to_fail > 0) {
+            num_uploads_to_fail--;
+            return false;
+        }
+        layer_uploads.push_back({slot, pixels[0]});
+        return true;
+    }
+    void upload_indirection_table(const std::vector<int> &slot_of_container) override {
+        indirection_tables.push_back(slot_of_container);
+    }
+
+    std::vector<LayerUpload> layer_uploads;
+    std::vector<std::vector<int>> indirection_tables;
+    /// the next this many uploads fail
+    int num_uploads_to_fail = 0;
+};
+
+std::vector<CpuLayer> make_cpu_layers(int num_containers) {
+    std::vector<CpuLayer> cpu_layers(num_containers);
+    for (int i = 0; i < num_containers; ++i) {
+        cpu_layers[i].width = 1;
+        cpu_layers[i].height = 1;
+        cpu_layers[i].pixels.assign(4, static_cast<uint8_t>(i));
+    }
+    return cpu_layers;
+}
+
+LayerResidencyManager make_manager(int num_containers, int num_slots, RecordingLayerUploadBackend *&backend,
+                                   int max_uploads_per_frame = 0) {
+    auto recording_backend = std::make_unique<RecordingLayerUploadBackend>();
+    backend = recording_backend.get();
+    return LayerResidencyManager(make_cpu_layers(num_containers), 4, num_slots, std::move(recording_backend),
+                                 max_uploads_per_frame);
+}
+
+void test_free_slots_are_filled_in_request_order() {
+    RecordingLayerUploadBackend *backend;
+    LayerResidencyManager manager = make_manager(4, 3, backend);
+
+    manager.request(2);
+    manager.request(0);
+    manager.update();
+
+    CHECK(backend->layer_uploads.size() == 2);
+    CHECK(backend->layer_uploads[0].slot == 0 && backend->layer_uploads[0].container_index == 2);
+    CHECK(backend->layer_uploads[1].slot == 1 && backend->layer_uploads[1].container_index == 0);
+    CHECK(backend->indirection_tables.size() == 1);
+    CHECK((backend->indirection_tables.back() == std::vector<int>{1, -1, 0, -1}));
+
+    // nothing changed, so neither the layers nor the table are uploaded again
+    manager.request(2);
+    manager.request(0);
+    manager.update();
+    CHECK(backend->layer_uploads.size() == 2);
+    CHECK(backend->indirection_tables.size() == 1);
+}
+
+void test_least_recently_requested_layer_is_evicted() {
+    RecordingLayerUploadBackend *backend;
+    LayerResidencyManager manager = make_manager(3, 2, backend);
+
+    manager.request(0);
+    manager.request(1);
+    manager.update();
+    manager.request(0);
+    manager.update();
+    manager.request(2);
+    manager.update();
+
+    // container 1 was last requested before container 0, so its slot is the one given up
+    CHECK(backend->layer_uploads.back().slot == 1 && backend->layer_uploads.back().container_index == 2);
+    CHECK(manager.is_resident(0));
+    CHECK(!manager.is_resident(1));
+    CHECK(manager.get_slot_of_container(2) == 1);
+    CHECK(manager.get_stats().num_evictions == 1);
+    CHECK((backend->indirection_tables.back() == std::vector<int>{0, -1, 1}));
+}
+
+void test_least_recently_requested_ties_go_to_the_lowest_slot() {
+    RecordingLayerUploadBackend *backend;
+    LayerResidencyManager manager = make_manager(3, 2, backend);
+
+    manager.request(1);
+    manager.request(0);
+    manager.update();
+    manager.request(2);
+    manager.update();
+
+    // containers 1 and 0 were both last requested in the first frame, container 1 sits in slot 0
+    CHECK(manager.get_slot_of_container(2) == 0);
+    CHECK(!manager.is_resident(1));
+    CHECK(manager.is_resident(0));
+}
+
+void test_higher_priority_is_paged_in_first_and_equal_priorities_keep_request_order() {
+    RecordingLayerUploadBackend *backend;
+    LayerResidencyManager manager = make_manager(4, 2, backend);
+
+    manager.request(0, 1);
+    manager.request(1, 5);
+    manager.request(2, 1);
+    manager.request(3, 1);
+    manager.update();
+
+    CHECK(backend->layer_uploads.size() == 2);
+    CHECK(backend->layer_uploads[0].container_index == 1);
+    CHECK(backend->layer_uploads[1].container_index == 0);
+    CHECK(!manager.is_resident(2));
+    CHECK(!manager.is_resident(3));
+    CHECK(manager.get_stats().num_unserved_requests == 2);
+}
+
+void test_requesting_twice_keeps_the_highest_priority() {
+    RecordingLayerUploadBackend *backend;
+    LayerResidencyManager manager = make_manager(2, 1, backend);
+
+    manager.request(0, 3);
+    manager.request(1, 2);
+    manager.request(1, 7);
+    manager.request(0, 1);
+    manager.update();
+
+    CHECK(manager.is_resident(1));
+    CHECK(!manager.is_resident(0));
+}
+
+void test_layers_requested_this_frame_are_never_evicted_when_the_pool_is_exhausted() {
+    RecordingLayerUploadBackend *backend;
+    LayerResidencyManager manager = make_manager(3, 2, backend);
+
+    manager.request(0);
+    manager.request(1);
+    manager.update();
+
+    // container 2 outranks both resident layers, but they are drawn this frame too
+    manager.request(0);
+    manager.request(1);
+    manager.request(2, 10);
+    manager.update();
+
+    CHECK(manager.get_slot_of_container(0) == 0);
+    CHECK(manager.get_slot_of_container(1) == 1);
+    CHECK(manager.get_slot_of_container(2) == -1);
+    CHECK(backend->layer_uploads.size() == 2);
+    CHECK(manager.get_stats().num_evictions == 0);
+    CHECK(manager.get_stats().num_unserved_requests == 1);
+
+    // once a slot isn't needed the overflow is served
+    manager.request(2, 10);
+    manager.update();
+    CHECK(manager.is_resident(2));
+    CHECK(manager.get_stats().num_evictions == 1);
+}
+
+void test_uploads_per_frame_are_capped() {
+    RecordingLayerUploadBackend *backend;
+    LayerResidencyManager manager = make_manager(3, 3, backend, 1);
+
+    manager.request(0);
+    manager.request(1, 1);
+    manager.request(2);
+    manager.update();
+    CHECK(backend->layer_uploads.size() == 1);
+    CHECK(backend->layer_uploads[0].container_index == 1);
+
+    manager.request(0);
+    manager.request(2);
+    manager.update();
+    CHECK(backend->layer_uploads.size() == 2);
+    CHECK(backend->layer_uploads[1].container_index == 0);
+}
+
+void test_failed_uploads_free_their_slot_and_dont_count_against_the_cap() {
+    RecordingLayerUploadBackend *backend;
+    LayerResidencyManager manager = make_manager(3, 2, backend, 1);
+
+    manager.request(0);
+    manager.update();
+    manager.request(1);
+    manager.update();
+
+    // both slots are full, so container 2 replaces the least recently requested container 0, and that upload fails
+    backend->num_uploads_to_fail = 1;
+    manager.request(2);
+    manager.update();
+    CHECK(!manager.is_resident(0));
+    CHECK(!manager.is_resident(2));
+    CHECK(manager.get_stats().num_failed_uploads == 1);
+    CHECK((backend->indirection_tables.back() == std::vector<int>{-1, 1, -1}));
+
+    // the failed upload didn't use up the frame's single upload, so the next request in the same frame still goes in
+    backend->num_uploads_to_fail = 1;
+    manager.request(2, 1);
+    manager.request(0);
+    manager.update();
+    CHECK(!manager.is_resident(2));
+    CHECK(manager.get_slot_of_container(0) == 0);
+    CHECK(manager.get_stats().num_uploads == 3);
+}
+
+void test_requesting_a_missing_container_throws() {
+    RecordingLayerUploadBackend *backend;
+    LayerResidencyManager manager = make_manager(2, 1, backend);
+
+    bool threw = false;
+    try {
+        manager.request(2);
+    } catch (const std::out_of_range &) {
+        threw = true;
+    }
+    CHECK(threw);
+}
+
+int main() {
+    test_free_slots_are_filled_in_request_order();
+    test_least_recently_requested_layer_is_evicted();
+    test_least_recently_requested_ties_go_to_the_lowest_slot();
+    test_higher_priority_is_paged_in_first_and_equal_priorities_keep_request_order();
+    test_requesting_twice_keeps_the_highest_priority();
+    test_layers_requested_this_frame_are_never_evicted_when_the_pool_is_exhausted();
+    test_uploads_per_frame_are_capped();
+    test_failed_uploads_free_their_slot_and_dont_count_against_the_cap();
+    test_requesting_a_missing_container_throws();
+    return report_checks("layer residency tests");
+}
@@ -0,0 +1,129 @@
+// Needs a current OpenGL context with the gl functions loaded before main runs the test, and links against the
+// texture packer sources, stb and the logger. It exits with 1 if any check failed.
+
+#include "../texture_packer.hpp"
+#include "check.hpp"
+
+#include <stb_image_write.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+void write_test_texture(const std::filesystem::path &file_path, int width, int height) {
+    std::vector<uint8_t> pixels(static_cast<size_t>(width) * height * 4, 255);
+    stbi_write_png(file_path.string().c_str(), width, height, 4, pixels.data(), width * 4);
+}
+
+void test_a_bake_over_the_budget_leaves_the_loaded_bake_usable() {
+    std::filesystem::path test_directory = std::filesystem::temp_directory_path() / "texture_packer_budget_test";
+    std::filesystem::remove_all(test_directory);
+    std::filesystem::path textures_directory = test_directory / "textures";
+    std::filesystem::path output_dir = test_directory / "packed";
+    std::filesystem::create_directories(textures_directory);
+    write_test_texture(textures_directory / "a.png", 32, 32);
+
+    TexturePacker texture_packer(textures_directory, output_dir, 64);
+    std::shared_ptr<const PackedTextureLookup> loaded_lookup = texture_packer.get_packed_texture_lookup();
+    GLuint loaded_gl_id = texture_packer.format_to_packed_texture_array.at(TextureFormat::rgba8).gl_id;
+    size_t loaded_gpu_bytes = texture_packer.get_atlas_report().total_gpu_bytes;
+    CHECK(loaded_gl_id != 0);
+
+    // the new texture needs a bigger container, which is over a budget that only fits the loaded bake
+    write_test_texture(textures_directory / "b.png", 128, 128);
+    texture_packer.max_container_side_length = 128;
+    texture_packer.settings.gpu_memory_budget_bytes = loaded_gpu_bytes;
+    texture_packer.settings.gpu_memory_budget_action = BudgetAction::fail;
+
+    bool threw = false;
+    try {
+        texture_packer.regenerate({(textures_directory / "b.png").string()});
+    } catch (const std::runtime_error &) {
+        threw = true;
+    }
+    CHECK(threw);
+
+    // the texture arrays, the side length, the report and the snapshot all still describe the loaded bake
+    CHECK(texture_packer.get_packed_texture_lookup() == loaded_lookup);
+    CHECK(texture_packer.format_to_packed_texture_array.size() == 1);
+    CHECK(texture_packer.format_to_packed_texture_array.at(TextureFormat::rgba8).gl_id == loaded_gl_id);
+    CHECK(texture_packer.format_to_packed_texture_array.at(TextureFormat::rgba8).container_side_length == 64);
+    CHECK(texture_packer.container_side_length == 64);
+    CHECK(texture_packer.get_atlas_report().total_gpu_bytes == loaded_gpu_bytes);
+    CHECK(texture_packer.get_packed_texture_index_of_texture((textures_directory / "a.png").string()) == 0);
+
+    std::filesystem::remove_all(test_directory);
+}
+
+void test_reloading_deletes_the_replaced_texture_arrays() {
+    std::filesystem::path test_directory = std::filesystem::temp_directory_path() / "texture_packer_reload_test";
+    std::filesystem::remove_all(test_directory);
+    std::filesystem::path textures_directory = test_directory / "textures";
+    std::filesystem::create_directories(textures_directory);
+    write_test_texture(textures_directory / "a.png", 32, 32);
+
+    TexturePacker texture_packer(textures_directory, test_directory / "packed", 64);
+    GLuint loaded_gl_id = texture_packer.format_to_packed_texture_array.at(TextureFormat::rgba8).gl_id;
+
+    write_test_texture(textures_directory / "b.png", 32, 32);
+    texture_packer.regenerate({(textures_directory / "b.png").string()});
+    GLuint reloaded_gl_id = texture_packer.format_to_packed_texture_array.at(TextureFormat::rgba8).gl_id;
+
+    CHECK(reloaded_gl_id != loaded_gl_id);
+    CHECK(glIsTexture(reloaded_gl_id));
+    CHECK(!glIsTexture(loaded_gl_id));
+
+    std::filesystem::remove_all(test_directory);
+}
+
+void test_a_bake_without_textures_fails_the_ready_future() {
+    std::filesystem::path test_directory = std::filesystem::temp_directory_path() / "texture_packer_empty_test";
+    std::filesystem::remove_all(test_directory);
+    std::filesystem::create_directories(test_directory / "textures");
+
+    TexturePackerSettings settings;
+    settings.executor = [](std::function<void()> job) { job(); };
+    TexturePacker texture_packer(test_directory / "textures", test_directory / "packed", 64, settings);
+    texture_packer.process_pending_gl_work();
+
+    bool threw = false;
+    try {
+        texture_packer.get_ready_future().get();
+    } catch (const std::runtime_error &) {
+        threw = true;
+    }
+    CHECK(threw);
+
+    std::filesystem::remove_all(test_directory);
+}
+
+void test_destroying_the_packer_cancels_a_bake_the_executor_never_started() {
+    std::filesystem::path test_directory = std::filesystem::temp_directory_path() / "texture_packer_cancel_test";
+    std::filesystem::remove_all(test_directory);
+    std::filesystem::create_directories(test_directory / "textures");
+
+    std::function<void()> dropped_job;
+    TexturePackerSettings settings;
+    settings.executor = [&](std::function<void()> job) { dropped_job = std::move(job); };
+    {
+        // would hang here if the destructor waited for the job
+        TexturePacker texture_packer(test_directory / "textures", test_directory / "packed", 64, settings);
+    }
+
+    // running the job after the packer is gone returns without touching it
+    dropped_job();
+    CHECK(!std::filesystem::exists(test_directory / "packed" / "packed_textures.json"));
+
+    std::filesystem::remove_all(test_directory);
+}
+
+int main() {
+    test_a_bake_over_the_budget_leaves_the_loaded_bake_usable();
+    test_reloading_deletes_the_replaced_texture_arrays();
+    test_a_bake_without_textures_fails_the_ready_future();
+    test_destroying_the_packer_cancels_a_bake_the_executor_never_started();
+    return report_checks("texture packer reload tests");
+}
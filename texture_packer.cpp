@@ -1,6 +1,9 @@
 #include "texture_packer.hpp"
+#include "allocation_counter.hpp"
+#include "gl_layer_upload_backend.hpp"
 #include <stb_image.h>
 #include <stb_image_write.h>
+#include <stb_image_resize2.h>
 #include <iostream>
 #include <nlohmann/json.hpp>
 #include <fstream>
@@ -18,6 +21,12 @@
 #include <stdexcept>
 #include <glm/vec2.hpp>
 #include <vector>
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <cmath>
+#include <cctype>
+#include <cstdlib>
 
 // NOTE: this can probably be replaced by something in fs utils later on
 void create_directory_if_needed(const std::filesystem::path &output_dir) {
@@ -39,12 +48,48 @@ void create_directory_if_needed(const std::filesystem::path &output_dir) {
 }
 
 TexturePacker::TexturePacker(const std::filesystem::path &textures_directory, const std::filesystem::path &output_dir,
-                             int container_side_length)
-    : textures_directory(textures_directory), output_dir(output_dir), container_side_length(container_side_length) {
+                             int container_side_length, const TexturePackerSettings &settings)
+    : textures_directory(textures_directory), output_dir(output_dir), container_side_length(container_side_length),
+      max_container_side_length(container_side_length), settings(settings) {
 
+    publish_packed_texture_lookup(std::make_shared<const PackedTextureLookup>());
     create_directory_if_needed(output_dir);
-    std::vector<std::string> initial_texture_paths = get_texture_paths(textures_directory, output_dir);
-    regenerate(initial_texture_paths);
+
+    if (!settings.executor) {
+        std::vector<std::string> initial_texture_paths = get_texture_paths(textures_directory, output_dir);
+        regenerate(initial_texture_paths);
+        mark_ready();
+        return;
+    }
+
+    // the last bake is served as soon as the gl thread gets to it, even though it may turn out to be stale
+    if (std::filesystem::exists(output_dir / "packed_textures.json")) {
+        enqueue_gl_work([this] {
+            try {
+                load_bake();
+                previous_bake_loaded = true;
+            } catch (const std::exception &e) {
+                global_logger.warn("Couldn't load the previous bake in {}: {}", this->output_dir.string(), e.what());
+            }
+        });
+    }
+
+    background_bake_finished_future = background_bake_finished.get_future();
+    background_bake_claimed = std::make_shared<std::atomic<bool>>(false);
+    settings.executor([this, claimed = background_bake_claimed] {
+        // the packer claimed the job first when it was destroyed before the executor got to it, it may be gone now
+        if (claimed->exchange(true)) {
+            return;
+        }
+        bake_in_background();
+    });
+}
+
+TexturePacker::~TexturePacker() {
+    // a job the executor never started is claimed here so it won't start anymore, only a started one is waited on
+    if (background_bake_claimed && background_bake_claimed->exchange(true)) {
+        background_bake_finished_future.wait();
+    }
 }
 
 std::vector<std::string> TexturePacker::get_texture_paths(const std::filesystem::path &directory,
@@ -53,7 +98,16 @@ std::vector<std::string> TexturePacker::get_texture_paths(const std::filesystem:
     std::vector<std::string> image_file_paths;
 
     // Walk through the directory and subdirectories
-    for (const std::filesystem::directory_entry &entry : std::filesystem::recursive_directory_iterator(directory)) {
+    for (auto it = std::filesystem::recursive_directory_iterator(directory);
+         it != std::filesystem::recursive_directory_iterator(); ++it) {
+        const std::filesystem::directory_entry &entry = *it;
+
+        // the output directory holds the staging directory of background bakes, none of it is a source texture
+        if (entry.is_directory() && std::filesystem::equivalent(entry.path(), output_dir)) {
+            it.disable_recursion_pending();
+            continue;
+        }
+
         if (entry.is_regular_file()) {
             std::string file = entry.path().filename().string();
 
@@ -73,207 +127,676 @@ std::vector<std::string> TexturePacker::get_texture_paths(const std::filesystem:
             }
         }
     }
+
+    // directory iteration order is unspecified, sorting keeps bakes identical across machines
+    std::sort(image_file_paths.begin(), image_file_paths.end());
     return image_file_paths;
 }
 
 bool is_power_of_two(int n) { return n > 0 && (n & (n - 1)) == 0; }
 
-void TexturePacker::pack_textures(const std::vector<std::string> &texture_paths,
-                                  const std::filesystem::path &output_dir, int container_side_length) {
+int num_channels(TextureFormat format) {
+    switch (format) {
+    case TextureFormat::r8:
+        return 1;
+    case TextureFormat::rg8:
+        return 2;
+    case TextureFormat::rgba8:
+        return 4;
+    }
+    return 4;
+}
 
-    // Step 1: Construct texture blocks from the provided texture paths
-    std::vector<TextureBlock> texture_blocks = construct_texture_blocks_from_texture_paths(texture_paths);
-    for (const auto &block : texture_blocks) {
-        global_logger.info("  - TextureBlock: {}", block.texture_path);
-        global_logger.info("      Dimensions: {}x{}", block.block.w, block.block.h);
-        global_logger.info("      Subtextures: [");
-        for (const auto &[key, value] : block.subtextures) {
-            std::string subtexture_str = "        \"" + key + "\": {";
-            for (const auto &[sub_key, sub_value] : value) {
-                subtexture_str += " \"" + sub_key + "\": " + std::to_string(sub_value) + ",";
-            }
-            subtexture_str += " }";
-            global_logger.info("{}", subtexture_str);
+std::string to_string(TextureFormat format) {
+    switch (format) {
+    case TextureFormat::r8:
+        return "r8";
+    case TextureFormat::rg8:
+        return "rg8";
+    case TextureFormat::rgba8:
+        return "rgba8";
+    }
+    return "rgba8";
+}
+
+TextureFormat texture_format_from_string(const std::string &format) {
+    if (format == "r8") {
+        return TextureFormat::r8;
+    }
+    if (format == "rg8") {
+        return TextureFormat::rg8;
+    }
+    if (format == "rgba8") {
+        return TextureFormat::rgba8;
+    }
+    throw std::runtime_error("Unknown texture format: " + format);
+}
+
+TextureFormat texture_format_from_num_channels(int num_channels) {
+    if (num_channels == 1) {
+        return TextureFormat::r8;
+    }
+    if (num_channels == 2) {
+        return TextureFormat::rg8;
+    }
+    return TextureFormat::rgba8;
+}
+
+std::string packed_texture_filename(TextureFormat format, int container_index) {
+    if (format == TextureFormat::rgba8) {
+        return "packed_texture_" + std::to_string(container_index) + ".png";
+    }
+    return "packed_texture_" + to_string(format) + "_" + std::to_string(container_index) + ".png";
+}
+
+GLenum texture_unit_of_format(TextureFormat format) {
+    switch (format) {
+    case TextureFormat::rgba8:
+        return GL_TEXTURE0;
+    case TextureFormat::r8:
+        return GL_TEXTURE2;
+    case TextureFormat::rg8:
+        return GL_TEXTURE3;
+    }
+    return GL_TEXTURE0;
+}
+
+GLenum indirection_table_unit_of_format(TextureFormat format) {
+    switch (format) {
+    case TextureFormat::rgba8:
+        return GL_TEXTURE4;
+    case TextureFormat::r8:
+        return GL_TEXTURE5;
+    case TextureFormat::rg8:
+        return GL_TEXTURE6;
+    }
+    return GL_TEXTURE4;
+}
+
+/** @brief Deletes the gl texture of every array that has one, which leaves its `gl_id` at 0. */
+void delete_packed_texture_arrays(std::map<TextureFormat, PackedTextureArray> &format_to_packed_texture_array) {
+    for (auto &[format, packed_texture_array] : format_to_packed_texture_array) {
+        if (packed_texture_array.gl_id != 0) {
+            glDeleteTextures(1, &packed_texture_array.gl_id);
+            packed_texture_array.gl_id = 0;
         }
-        global_logger.info("      ]");
     }
+}
 
-    // Step 2: Pack the texture blocks into containers
-    std::vector<PackedTextureContainer> packed_texture_containers =
-        pack_texture_blocks_into_containers(texture_blocks, container_side_length);
-    global_logger.info("Packed texture blocks into {} containers:", packed_texture_containers.size());
+int round_up_to_multiple_of_four(int n) { return (n + 3) & ~3; }
 
-    for (size_t i = 0; i < packed_texture_containers.size(); ++i) {
-        const auto &container = packed_texture_containers[i];
-        global_logger.info("Container {}:", i);
-        global_logger.info("  - Number of packed blocks: {}", container.packed_texture_blocks.size());
-        for (const auto &block : container.packed_texture_blocks) {
-            global_logger.info("    - TextureBlock: {}", block.texture_path);
-            global_logger.info("        Dimensions: {}x{}", block.block.w, block.block.h);
-            if (block.block.packed_placement) {
-                const auto &placement = block.block.packed_placement.value();
-                global_logger.info("        Placement: ({}, {})", placement.top_left_x, placement.top_left_y);
-            } else {
-                global_logger.info("        Placement: Not packed");
-            }
-            global_logger.info("        Subtextures: [");
-            for (const auto &[key, value] : block.subtextures) {
-                std::string subtexture_str = "          \"" + key + "\": {";
-                for (const auto &[sub_key, sub_value] : value) {
-                    subtexture_str += " \"" + sub_key + "\": " + std::to_string(sub_value) + ",";
-                }
-                subtexture_str += " }";
-                global_logger.info("{}", subtexture_str);
+/// the bounding box buffer never holds fewer texels than this, which was the fixed width of the texture it replaced
+constexpr size_t min_bounding_box_buffer_size = 1024;
+
+/**
+ * @brief The number of texels the bounding box buffer holding `num_entries` boxes is allocated with, a power of two so
+ * that it only has to be reallocated once the number of entries crosses one.
+ */
+size_t bounding_box_buffer_size(size_t num_entries) {
+    size_t size = min_bounding_box_buffer_size;
+    while (size < num_entries) {
+        size *= 2;
+    }
+    return size;
+}
+
+/**
+ * @brief Visits every entry nested in the sub-atlas of `sub_texture`, each one before the entries inside of it and
+ * siblings in name order, which is the order their bounding box indices are handed out in.
+ *
+ * @param sub_texture_names The names leading from `sub_texture` down to the visited entry, passed to `visit`.
+ */
+template <typename SubTexture, typename Visitor>
+void for_each_sub_atlas_entry(SubTexture &sub_texture, std::vector<std::string> &sub_texture_names, Visitor &&visit) {
+    for (auto &[sub_texture_name, sub_atlas_sub_texture] : sub_texture.sub_atlas) {
+        sub_texture_names.push_back(sub_texture_name);
+        visit(static_cast<const std::vector<std::string> &>(sub_texture_names), sub_atlas_sub_texture);
+        for_each_sub_atlas_entry(sub_atlas_sub_texture, sub_texture_names, visit);
+        sub_texture_names.pop_back();
+    }
+}
+
+/**
+ * @brief Unlinks a file that is about to be rewritten.
+ *
+ * Output files may be hard links into the bake cache, writing into them in place would change the cached copy too.
+ */
+void remove_before_overwriting(const std::filesystem::path &file_path) {
+    std::error_code error;
+    std::filesystem::remove(file_path, error);
+}
+
+/// bump this whenever the packed output changes for the same inputs, so that older bakes in the cache aren't reused
+/// 2: sub-texture rects are written as integers
+/// 3: every texture records its scale and source size
+/// 4: the metadata is written without indentation
+/// 5: sub-textures nest to any depth
+/// 6: the packing search tries every block ordering before the next split rule
+constexpr int bake_format_version = 6;
+
+std::string TexturePacker::compute_bake_key(const std::vector<std::string> &texture_paths,
+                                            int container_side_length) const {
+    LogSection _(global_logger, "compute_bake_key", true);
+
+    std::vector<std::string> sorted_texture_paths = texture_paths;
+    std::sort(sorted_texture_paths.begin(), sorted_texture_paths.end());
+
+    // hashing the image contents is the slow part, so every texture is hashed on its own first
+    std::vector<std::string> texture_digests(sorted_texture_paths.size());
+    parallel_for_each_index(sorted_texture_paths.size(), [&](size_t i) {
+        const std::string &file_path = sorted_texture_paths[i];
+        std::string json_path = file_path.substr(0, file_path.find_last_of('.')) + ".json";
+
+        ContentHash texture_hash;
+        texture_hash.update_field(file_path);
+        std::vector<uint8_t> image_bytes = read_file_bytes(file_path);
+        texture_hash.update_field(std::to_string(image_bytes.size()));
+        texture_hash.update(image_bytes);
+        // a missing sidecar and an empty one are different inputs
+        bool has_sidecar = std::filesystem::exists(json_path);
+        texture_hash.update_field(has_sidecar ? "sidecar" : "no sidecar");
+        if (has_sidecar) {
+            std::vector<uint8_t> sidecar_bytes = read_file_bytes(json_path);
+            texture_hash.update_field(std::to_string(sidecar_bytes.size()));
+            texture_hash.update(sidecar_bytes);
+        }
+        texture_digests[i] = texture_hash.hex_digest();
+    });
+
+    ContentHash bake_hash;
+    bake_hash.update_field("texture_packer bake " + std::to_string(bake_format_version));
+    bake_hash.update_field(std::to_string(container_side_length));
+    bake_hash.update_field(std::to_string(static_cast<int>(settings.container_sizing)));
+    bake_hash.update_field(std::to_string(settings.min_container_side_length));
+    bake_hash.update_field(std::to_string(settings.trim_last_container));
+    bake_hash.update_field(std::to_string(settings.packing_search_candidates));
+    bake_hash.update_field(std::to_string(settings.group_by_channel_count));
+    bake_hash.update_field(std::to_string(settings.downscale_oversized_textures));
+    bake_hash.update_field(std::to_string(settings.downscale_to_fit_gpu_memory_budget));
+    if (settings.downscale_to_fit_gpu_memory_budget) {
+        // the budget only changes the output through downscaling
+        bake_hash.update_field(std::to_string(settings.min_downscale));
+        bake_hash.update_field(std::to_string(settings.gpu_memory_budget_bytes));
+        bake_hash.update_field(std::to_string(settings.max_resident_layers));
+    }
+    for (const auto &[directory, priority] : settings.directory_priorities) {
+        bake_hash.update_field(directory.string());
+        bake_hash.update_field(std::to_string(priority));
+    }
+    bake_hash.update_field(std::to_string(texture_digests.size()));
+    for (const auto &texture_digest : texture_digests) {
+        bake_hash.update_field(texture_digest);
+    }
+    return bake_hash.hex_digest();
+}
+
+/**
+ * @brief Lists the files making up the bake in `output_dir`, as recorded in its packed_textures.json.
+ */
+std::vector<std::string> list_bake_bundle_filenames(const std::filesystem::path &output_dir) {
+    std::vector<std::string> filenames = {"packed_textures.json"};
+    read_packed_textures_metadata(
+        output_dir / "packed_textures.json",
+        [&](const PackedFormatRecord &format_record) {
+            TextureFormat format = texture_format_from_string(format_record.format);
+            for (int i = 0; i < format_record.num_containers; ++i) {
+                filenames.push_back(packed_texture_filename(format, i));
             }
-            global_logger.info("        ]");
+        },
+        [](const PackedTextureRecord &) {});
+    return filenames;
+}
+
+/// the bake key of the bundle in a directory is stored next to it so a later run can tell if it's still up to date
+const std::string bake_key_filename = "bake_key.txt";
+/// background bakes are written here, inside the output directory, and moved into place on the gl thread
+const std::string staging_directory_name = "staging";
+
+/**
+ * @brief Reads the bake key stored in `bake_dir`, empty if there is none.
+ */
+std::string read_bake_key(const std::filesystem::path &bake_dir) {
+    std::ifstream file(bake_dir / bake_key_filename);
+    std::string bake_key;
+    std::getline(file, bake_key);
+    return bake_key;
+}
+
+/**
+ * @brief Stores the bake key of the bundle in `bake_dir`, an empty key removes the stored one.
+ */
+void write_bake_key(const std::filesystem::path &bake_dir, const std::string &bake_key) {
+    std::filesystem::path bake_key_path = bake_dir / bake_key_filename;
+    std::filesystem::remove(bake_key_path);
+    if (!bake_key.empty()) {
+        std::ofstream(bake_key_path) << bake_key << '\n';
+    }
+}
+
+/**
+ * @brief Moves every file of the staging directory into `output_dir` and removes the staging directory.
+ *
+ * The bake key is removed first and put back last, so an interrupted install is never mistaken for an up to date one.
+ */
+void install_staged_bake(const std::filesystem::path &staging_dir, const std::filesystem::path &output_dir) {
+    std::filesystem::remove(output_dir / bake_key_filename);
+    for (const auto &entry : std::filesystem::directory_iterator(staging_dir)) {
+        if (entry.path().filename() != bake_key_filename) {
+            // renaming replaces the old file's directory entry, so a hard link into the bake cache is left alone
+            std::filesystem::rename(entry.path(), output_dir / entry.path().filename());
         }
     }
+    if (std::filesystem::exists(staging_dir / bake_key_filename)) {
+        std::filesystem::rename(staging_dir / bake_key_filename, output_dir / bake_key_filename);
+    }
+    std::filesystem::remove_all(staging_dir);
+}
 
-    // Step 3: Prepare JSON metadata and write packed texture images
-    nlohmann::json result;
+int TexturePacker::choose_container_side_length(const BlockSizes &blocks, int max_container_side_length) {
+    LogSection _(global_logger, "choose_container_side_length", true);
 
-    for (size_t i = 0; i < packed_texture_containers.size(); ++i) {
-        const auto &container = packed_texture_containers[i];
-        global_logger.info("Processing container {} with {} texture blocks.", i,
-                           container.packed_texture_blocks.size());
+    int largest_side = 1;
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        largest_side = std::max({largest_side, blocks.widths[i], blocks.heights[i]});
+    }
 
-        std::vector<uint8_t> image_data(container_side_length * container_side_length * 4, 0); // Assuming RGBA format
+    // anything smaller than the largest texture can't hold every texture, so don't bother trying it
+    int smallest_side = std::max(largest_side, settings.min_container_side_length);
 
-        for (const auto &block : container.packed_texture_blocks) {
-            if (!block.block.packed_placement.has_value()) {
-                global_logger.warn("Skipping block without placement: {}", block.texture_path);
-                continue; // Skip blocks that were not successfully packed
+    std::vector<int> candidate_side_lengths;
+    if (settings.container_sizing == ContainerSizing::auto_power_of_two) {
+        for (int side = 1; side > 0 && side <= max_container_side_length; side *= 2) {
+            if (side >= smallest_side) {
+                candidate_side_lengths.push_back(side);
             }
+        }
+    } else if (settings.container_sizing == ContainerSizing::auto_multiple_of_four) {
+        for (int side = round_up_to_multiple_of_four(smallest_side); side <= max_container_side_length; side += 4) {
+            candidate_side_lengths.push_back(side);
+        }
+    }
 
-            const auto &placement = block.block.packed_placement.value();
-            global_logger.info("Processing block: {} at position ({}, {})", block.texture_path, placement.top_left_x,
-                               placement.top_left_y);
+    if (candidate_side_lengths.empty()) {
+        global_logger.warn("No candidate container side length between {} and {}, using {}", smallest_side,
+                           max_container_side_length, max_container_side_length);
+        return max_container_side_length;
+    }
 
-            // Load the block image (e.g., using stb_image)
-            int img_width, img_height, channels;
-            std::unique_ptr<uint8_t[], void (*)(void *)> block_image(
-                stbi_load(block.texture_path.c_str(), &img_width, &img_height, &channels, 4), stbi_image_free);
+    // every candidate is trial packed with the default strategy, the strategy search only runs on the chosen size
+    std::vector<std::optional<int>> num_containers_needed(candidate_side_lengths.size());
+    parallel_for_each_index(candidate_side_lengths.size(), [&](size_t i) {
+        PackingResult packing = pack_blocks(blocks, candidate_side_lengths[i], PackingStrategy{});
+        if (packing.num_unplaced_blocks == 0) {
+            num_containers_needed[i] = packing.num_containers();
+        }
+    });
 
-            if (!block_image) {
-                global_logger.error("Failed to load texture: {}", block.texture_path);
-                continue;
-            }
+    // candidates are in increasing order, so the first one with the fewest containers is also the smallest one
+    std::optional<size_t> best_index;
+    for (size_t i = 0; i < candidate_side_lengths.size(); ++i) {
+        if (num_containers_needed[i] &&
+            (!best_index || *num_containers_needed[i] < *num_containers_needed[*best_index])) {
+            best_index = i;
+        }
+    }
 
-            global_logger.info("Loaded image: {} with dimensions ({}x{})", block.texture_path, img_width, img_height);
-
-            // Copy the block image into the container image at the specified position
-            for (int row = 0; row < img_height; ++row) {
-                for (int col = 0; col < img_width; ++col) {
-                    for (int channel = 0; channel < 4; ++channel) {
-                        int dest_x = placement.top_left_x + col;
-                        int dest_y = placement.top_left_y + row;
-                        if (dest_x < 0 || dest_x >= container_side_length || dest_y < 0 ||
-                            dest_y >= container_side_length) {
-                            global_logger.error("Out-of-bounds access detected for block: {}", block.texture_path);
-                            continue;
-                        }
-                        image_data[(dest_y * container_side_length + dest_x) * 4 + channel] =
-                            block_image[(row * img_width + col) * 4 + channel];
-                    }
-                }
-            }
+    if (!best_index) {
+        global_logger.warn("None of the candidate container side lengths could fit every texture, using {}",
+                           max_container_side_length);
+        return max_container_side_length;
+    }
 
-            // Add metadata for this block
-            result["sub_textures"][block.texture_path] = {{"container_index", static_cast<int>(i)},
-                                                          {"x", placement.top_left_x},
-                                                          {"y", placement.top_left_y},
-                                                          {"width", block.block.w},
-                                                          {"height", block.block.h},
-                                                          {"sub_textures", block.subtextures}};
+    int chosen_side_length = candidate_side_lengths[*best_index];
+    int chosen_num_containers = *num_containers_needed[*best_index];
+
+    int num_containers_at_max = pack_blocks(blocks, max_container_side_length, PackingStrategy{}).num_containers();
+    size_t chosen_bytes = static_cast<size_t>(chosen_num_containers) * chosen_side_length * chosen_side_length * 4;
+    size_t max_bytes =
+        static_cast<size_t>(num_containers_at_max) * max_container_side_length * max_container_side_length * 4;
+
+    global_logger.info("Chose container side length {} ({} containers, {} bytes) out of {} candidates, saving {} "
+                       "bytes compared to {}x{} containers",
+                       chosen_side_length, chosen_num_containers, chosen_bytes, candidate_side_lengths.size(),
+                       max_bytes > chosen_bytes ? max_bytes - chosen_bytes : 0, max_container_side_length,
+                       max_container_side_length);
+
+    return chosen_side_length;
+}
+
+void TexturePacker::pack_textures(const std::vector<std::string> &texture_paths,
+                                  const std::filesystem::path &output_dir, int container_side_length) {
+
+    // the packer breaks ties by input order, so the paths are sorted to make the output only depend on the set of them
+    std::vector<std::string> sorted_texture_paths = texture_paths;
+    std::sort(sorted_texture_paths.begin(), sorted_texture_paths.end());
+
+    // Step 1: Construct texture blocks from the provided texture paths
+    TextureBlockTable texture_blocks = construct_texture_blocks_from_texture_paths(sorted_texture_paths);
+    for (size_t id = 0; id < texture_blocks.size(); ++id) {
+        global_logger.info("  - TextureBlock: {}", texture_blocks.texture_paths[id]);
+        global_logger.info("      Dimensions: {}x{}", texture_blocks.sizes.widths[id],
+                           texture_blocks.sizes.heights[id]);
+        global_logger.info("      Subtextures: [");
+        for (const auto &record : texture_blocks.get_sub_textures(id)) {
+            global_logger.info("        \"{}\": {{ \"x\": {}, \"y\": {}, \"width\": {}, \"height\": {} }}",
+                               record.name, record.x, record.y, record.width, record.height);
         }
+        global_logger.info("      ]");
+    }
 
-        // Write the packed texture image to a file
-        std::string filename = "packed_texture_" + std::to_string(i) + ".png";
-        stbi_write_png((output_dir / filename).string().c_str(), container_side_length, container_side_length, 4,
-                       image_data.data(), container_side_length * 4);
+    // every format gets its own set of containers, when not grouping by channel count everything is rgba8
+    std::map<TextureFormat, std::vector<size_t>> format_to_texture_ids;
+    for (size_t id = 0; id < texture_blocks.size(); ++id) {
+        TextureFormat format = settings.group_by_channel_count
+                                   ? texture_format_from_num_channels(texture_blocks.num_channels[id])
+                                   : TextureFormat::rgba8;
+        format_to_texture_ids[format].push_back(id);
+    }
 
-        global_logger.info("Packed texture saved to {}", (output_dir / filename).string());
+    if (settings.downscale_oversized_textures) {
+        downscale_oversized_textures(texture_blocks, container_side_length);
+    }
+    if (settings.downscale_to_fit_gpu_memory_budget && settings.gpu_memory_budget_bytes != 0) {
+        downscale_to_fit_gpu_memory_budget(texture_blocks, format_to_texture_ids, container_side_length);
+    }
+
+    // one pool for every container of every format, starting threads per container would cost more than small
+    // containers take to load
+    ImageLoadingPool image_loading_pool(settings.image_loading);
+    nlohmann::json result;
+    for (const auto &[format, texture_ids] : format_to_texture_ids) {
+        int format_container_side_length = container_side_length;
+        if (settings.container_sizing != ContainerSizing::fixed) {
+            format_container_side_length =
+                choose_container_side_length(texture_blocks.sizes_of(texture_ids), container_side_length);
+        }
+        pack_texture_blocks_of_format(texture_blocks, texture_ids, format, format_container_side_length, output_dir,
+                                      image_loading_pool, result);
     }
 
     // Write metadata to JSON file
+    remove_before_overwriting(output_dir / "packed_textures.json");
     std::ofstream json_output(output_dir / "packed_textures.json");
-    json_output << result.dump(4);
+    // the metadata is only read back by the streaming parser, so indenting it would just make it bigger
+    json_output << result.dump();
     global_logger.info("Metadata saved to {}", (output_dir / "packed_textures.json").string());
 
     global_logger.info("Texture packing completed successfully.");
 }
 
-std::vector<PackedTextureContainer>
-TexturePacker::pack_texture_blocks_into_containers(std::vector<TextureBlock> &texture_blocks, int container_size) {
-    global_logger.info("Starting texture packing into containers. Container size: {}x{}", container_size,
-                       container_size);
-
-    // Sort by minimum side length in descending order
-    std::sort(texture_blocks.begin(), texture_blocks.end(), [](const TextureBlock &a, const TextureBlock &b) {
-        return std::min(a.block.w, a.block.h) > std::min(b.block.w, b.block.h);
-    });
+void TexturePacker::downscale_oversized_textures(TextureBlockTable &texture_blocks, int container_side_length) {
+    for (size_t id = 0; id < texture_blocks.size(); ++id) {
+        int source_width = texture_blocks.source_sizes.widths[id];
+        int source_height = texture_blocks.source_sizes.heights[id];
+        if (source_width <= container_side_length && source_height <= container_side_length) {
+            continue;
+        }
 
-    global_logger.info("Sorted texture blocks by minimum side length (descending order):");
-    for (const auto &tb : texture_blocks) {
-        global_logger.info("  - TextureBlock: {}\n      Dimensions: {}x{}", tb.texture_path, tb.block.w, tb.block.h);
+        float scale = std::min(static_cast<float>(container_side_length) / source_width,
+                               static_cast<float>(container_side_length) / source_height);
+        texture_blocks.set_scale(id, std::min(scale, texture_blocks.scales[id]));
+        global_logger.warn("Downscaled {} from {}x{} to {}x{} to fit in the {}x{} containers",
+                           texture_blocks.texture_paths[id], source_width, source_height,
+                           texture_blocks.sizes.widths[id], texture_blocks.sizes.heights[id], container_side_length,
+                           container_side_length);
     }
+}
 
-    std::vector<PackedTextureContainer> currently_created_packed_texture_containers;
-
-    for (auto &tb : texture_blocks) {
-        global_logger.info("Processing TextureBlock: {} with dimensions {}x{}", tb.texture_path, tb.block.w,
-                           tb.block.h);
+size_t TexturePacker::estimate_gpu_bytes(const TextureBlockTable &texture_blocks,
+                                         const std::map<TextureFormat, std::vector<size_t>> &format_to_texture_ids,
+                                         int container_side_length) const {
+    size_t num_entries = texture_blocks.size() + texture_blocks.sub_texture_records.size();
+    size_t bytes = bounding_box_buffer_size(num_entries) * sizeof(glm::vec4);
+    for (const auto &[format, texture_ids] : format_to_texture_ids) {
+        PackingResult packing = pack_blocks(texture_blocks.sizes_of(texture_ids), container_side_length, {});
+        int num_containers = packing.num_containers();
+        PackedTextureArray packed_texture_array{format, container_side_length, num_containers};
+        bytes += static_cast<size_t>(num_gpu_layers(packed_texture_array)) * container_side_length *
+                 container_side_length * num_channels(format);
+    }
+    return bytes;
+}
 
-        if (tb.block.w > container_size || tb.block.h > container_size) {
-            global_logger.error(
-                "The image {} has dimensions {}x{}, but the container is {}x{}. Make the container size bigger.",
-                tb.texture_path, tb.block.w, tb.block.h, container_size, container_size);
-            continue;
+void TexturePacker::downscale_to_fit_gpu_memory_budget(
+    TextureBlockTable &texture_blocks, const std::map<TextureFormat, std::vector<size_t>> &format_to_texture_ids,
+    int container_side_length) {
+    LogSection _(global_logger, "downscale_to_fit_gpu_memory_budget", true);
+
+    // every step halves the area of the texture
+    const float downscale_step = std::sqrt(0.5f);
+
+    std::set<int> priorities(texture_blocks.priorities.begin(), texture_blocks.priorities.end());
+    size_t estimated_bytes = estimate_gpu_bytes(texture_blocks, format_to_texture_ids, container_side_length);
+    size_t estimated_bytes_before = estimated_bytes;
+
+    for (int priority : priorities) {
+        while (estimated_bytes > settings.gpu_memory_budget_bytes) {
+            bool downscaled_any = false;
+            for (size_t id = 0; id < texture_blocks.size(); ++id) {
+                float scale = std::max(texture_blocks.scales[id] * downscale_step, settings.min_downscale);
+                if (texture_blocks.priorities[id] == priority && scale < texture_blocks.scales[id]) {
+                    texture_blocks.set_scale(id, scale);
+                    downscaled_any = true;
+                }
+            }
+            if (!downscaled_any) {
+                break;
+            }
+            estimated_bytes = estimate_gpu_bytes(texture_blocks, format_to_texture_ids, container_side_length);
+            global_logger.info("Downscaled priority {} textures, the bake is now estimated at {} bytes", priority,
+                               estimated_bytes);
+        }
+        if (estimated_bytes <= settings.gpu_memory_budget_bytes) {
+            break;
         }
+    }
 
-        bool found_container_to_fit_texture_in = false;
+    if (estimated_bytes > settings.gpu_memory_budget_bytes) {
+        global_logger.warn("Couldn't downscale the textures enough to fit the budget of {} bytes, the bake is "
+                           "estimated at {} bytes with every texture at the minimum scale of {}",
+                           settings.gpu_memory_budget_bytes, estimated_bytes, settings.min_downscale);
+    } else if (estimated_bytes != estimated_bytes_before) {
+        global_logger.info("Downscaled the bake from an estimated {} to {} bytes to fit the budget of {} bytes",
+                           estimated_bytes_before, estimated_bytes, settings.gpu_memory_budget_bytes);
+    }
+}
 
-        // Try to fit the texture block into an existing container
-        for (auto &pt_container : currently_created_packed_texture_containers) {
-            global_logger.info("  Attempting to fit into an existing container...");
+void TexturePacker::pack_texture_blocks_of_format(TextureBlockTable &texture_blocks,
+                                                  const std::vector<size_t> &texture_ids, TextureFormat format,
+                                                  int container_side_length, const std::filesystem::path &output_dir,
+                                                  ImageLoadingPool &image_loading_pool, nlohmann::json &result) {
+    int channels = num_channels(format);
 
-            pt_container.packer->fit(tb.block);
+    // Step 2: Pack the texture blocks into containers
+    std::vector<PackedTextureContainer> packed_texture_containers =
+        pack_texture_blocks_into_containers(texture_blocks, texture_ids, container_side_length);
+    global_logger.info("Packed {} texture blocks into {} containers:", to_string(format),
+                       packed_texture_containers.size());
 
-            // if the block has been fit in
-            if (tb.block.packed_placement) {
-                global_logger.info("    Successfully packed into existing container.");
-                for (auto &[_, subtexture_data] : tb.subtextures) {
-                    subtexture_data["x"] += tb.block.packed_placement->top_left_x;
-                    subtexture_data["y"] += tb.block.packed_placement->top_left_y;
+    // Step 3: Prepare JSON metadata and write packed texture images
+    result["formats"][to_string(format)] = {{"container_side_length", container_side_length},
+                                            {"num_containers", packed_texture_containers.size()}};
+
+    for (size_t i = 0; i < packed_texture_containers.size(); ++i) {
+        const auto &container = packed_texture_containers[i];
+        global_logger.info("Processing container {} with {} texture blocks.", i, container.texture_ids.size());
+
+        std::vector<uint8_t> image_data(container_side_length * container_side_length * channels, 0);
+
+        std::vector<std::string> paths_to_load;
+        int used_width = 0;
+        int used_height = 0;
+        for (size_t id : container.texture_ids) {
+            const std::string &texture_path = texture_blocks.texture_paths[id];
+            const BlockPlacement &placement = texture_blocks.placements[id].value();
+            int width = texture_blocks.sizes.widths[id];
+            int height = texture_blocks.sizes.heights[id];
+            global_logger.info("Processing block: {} ({}x{}) at position ({}, {})", texture_path, width, height,
+                               placement.top_left_x, placement.top_left_y);
+
+            paths_to_load.push_back(texture_path);
+            used_width = std::max(used_width, placement.top_left_x + width);
+            used_height = std::max(used_height, placement.top_left_y + height);
+
+            // sub-texture records are relative to their parent, so they are moved to where they are in the source
+            // image, scaled along with it and moved to where it was placed here
+            float scale_x = static_cast<float>(width) / texture_blocks.source_sizes.widths[id];
+            float scale_y = static_cast<float>(height) / texture_blocks.source_sizes.heights[id];
+            std::span<const SubTextureRecord> records = texture_blocks.get_sub_textures(id);
+            std::vector<glm::ivec2> source_positions(records.size());
+            std::vector<nlohmann::json *> record_jsons(records.size());
+            nlohmann::json sub_textures = nlohmann::json::object();
+            for (size_t r = 0; r < records.size(); ++r) {
+                const SubTextureRecord &record = records[r];
+                source_positions[r] = glm::ivec2(record.x, record.y);
+                nlohmann::json *siblings = &sub_textures;
+                if (record.parent >= 0) {
+                    source_positions[r] += source_positions[record.parent];
+                    siblings = &(*record_jsons[record.parent])["sub_textures"];
                 }
 
-                pt_container.packed_texture_blocks.push_back(tb);
-                found_container_to_fit_texture_in = true;
-                break;
-            } else {
-                global_logger.info("    Failed to fit into this container.");
+                int x = static_cast<int>(std::lround(source_positions[r].x * scale_x));
+                int y = static_cast<int>(std::lround(source_positions[r].y * scale_y));
+                // the json is a tree of std::maps, so the pointer stays valid while siblings are added
+                nlohmann::json &record_json = (*siblings)[record.name];
+                record_json = {{"x", placement.top_left_x + x},
+                               {"y", placement.top_left_y + y},
+                               {"width", static_cast<int>(std::lround(record.width * scale_x))},
+                               {"height", static_cast<int>(std::lround(record.height * scale_y))}};
+                record_jsons[r] = &record_json;
             }
+
+            // Add metadata for this block
+            result["sub_textures"][texture_path] = {{"container_index", static_cast<int>(i)},
+                                                    {"format", to_string(format)},
+                                                    {"x", placement.top_left_x},
+                                                    {"y", placement.top_left_y},
+                                                    {"width", width},
+                                                    {"height", height},
+                                                    {"scale", texture_blocks.scales[id]},
+                                                    {"source_width", texture_blocks.source_sizes.widths[id]},
+                                                    {"source_height", texture_blocks.source_sizes.heights[id]},
+                                                    {"sub_textures", std::move(sub_textures)}};
+        }
+
+        // the images are read and decoded on worker threads while earlier ones are copied in here
+        image_loading_pool.load_images(
+            paths_to_load, channels,
+            [&](LoadedImage &&block_image) {
+                size_t id = container.texture_ids[block_image.index];
+                const std::string &texture_path = texture_blocks.texture_paths[id];
+                const BlockPlacement &placement = texture_blocks.placements[id].value();
+
+                // the entry was written before decoding, a texture without pixels mustn't be looked up
+                if (!block_image.pixels) {
+                    global_logger.error("Failed to load texture: {}", texture_path);
+                    result["sub_textures"].erase(texture_path);
+                    return;
+                }
+
+                global_logger.info("Loaded image: {} with dimensions ({}x{})", texture_path, block_image.width,
+                                   block_image.height);
+
+                // downscaled textures are resampled to their packed size first
+                int width = texture_blocks.sizes.widths[id];
+                int height = texture_blocks.sizes.heights[id];
+                if (block_image.width != width || block_image.height != height) {
+                    stbir_pixel_layout pixel_layout = channels == 1   ? STBIR_1CHANNEL
+                                                      : channels == 2 ? STBIR_RA
+                                                                      : STBIR_RGBA;
+                    std::unique_ptr<uint8_t[], void (*)(void *)> resized_pixels{
+                        static_cast<uint8_t *>(std::malloc(static_cast<size_t>(width) * height * channels)), std::free};
+                    if (!stbir_resize_uint8_linear(block_image.pixels.get(), block_image.width, block_image.height, 0,
+                                                   resized_pixels.get(), width, height, 0, pixel_layout)) {
+                        global_logger.error("Failed to downscale texture: {}", texture_path);
+                        result["sub_textures"].erase(texture_path);
+                        return;
+                    }
+                    block_image.pixels = std::move(resized_pixels);
+                    block_image.width = width;
+                    block_image.height = height;
+                }
+
+                // Copy the block image into the container image at the specified position, a row at a time
+                int copy_width = std::min(block_image.width, container_side_length - placement.top_left_x);
+                int copy_height = std::min(block_image.height, container_side_length - placement.top_left_y);
+                if (copy_width != block_image.width || copy_height != block_image.height) {
+                    global_logger.error("Out-of-bounds access detected for block: {}", texture_path);
+                }
+
+                for (int row = 0; row < copy_height; ++row) {
+                    const uint8_t *source_row = block_image.pixels.get() + row * block_image.width * channels;
+                    uint8_t *dest_row = image_data.data() +
+                                        ((placement.top_left_y + row) * container_side_length + placement.top_left_x) *
+                                            channels;
+                    std::copy(source_row, source_row + copy_width * channels, dest_row);
+                }
+            });
+
+        // the last container is usually only partly filled, so only the part that is used gets written out, fixed
+        // sizing keeps writing full containers like it always has
+        int image_width = container_side_length;
+        int image_height = container_side_length;
+        bool trim = settings.trim_last_container && settings.container_sizing != ContainerSizing::fixed;
+        if (trim && i + 1 == packed_texture_containers.size()) {
+            image_width = std::clamp(round_up_to_multiple_of_four(used_width), 4, container_side_length);
+            image_height = std::clamp(round_up_to_multiple_of_four(used_height), 4, container_side_length);
+            global_logger.info("Trimmed the last container to {}x{}", image_width, image_height);
         }
 
-        if (!found_container_to_fit_texture_in) {
-            global_logger.info("  Creating a new container for the texture.");
+        // Write the packed texture image to a file
+        std::string filename = packed_texture_filename(format, static_cast<int>(i));
+        remove_before_overwriting(output_dir / filename);
+        stbi_write_png((output_dir / filename).string().c_str(), image_width, image_height, channels,
+                       image_data.data(), container_side_length * channels);
 
-            auto new_packer = std::make_shared<SplitPacker>(container_size, container_size);
-            new_packer->fit(tb.block);
+        global_logger.info("Packed texture saved to {}", (output_dir / filename).string());
+    }
+}
 
-            PackedTextureContainer pt(new_packer);
+std::vector<PackedTextureContainer>
+TexturePacker::pack_texture_blocks_into_containers(TextureBlockTable &texture_blocks,
+                                                   const std::vector<size_t> &texture_ids, int container_size) {
+    global_logger.info("Starting texture packing into containers. Container size: {}x{}", container_size,
+                       container_size);
+    // process wide, so the search's worker threads are counted, and so is anything else running meanwhile
+    size_t num_allocations_at_start = get_num_allocations();
 
-            if (tb.block.packed_placement) {
-                global_logger.info("    Successfully packed into the new container.");
-                pt.packed_texture_blocks.push_back(tb);
-                // No need to update subtexture data, as it's in the top-left corner
-            } else {
-                global_logger.error("    Created a new container, but the texture still couldn't fit: {}",
-                                    tb.texture_path);
-            }
+    BlockSizes blocks = texture_blocks.sizes_of(texture_ids);
+    for (size_t i = 0; i < texture_ids.size(); ++i) {
+        if (blocks.widths[i] > container_size || blocks.heights[i] > container_size) {
+            global_logger.error(
+                "The image {} has dimensions {}x{}, but the container is {}x{}. Make the container size bigger.",
+                texture_blocks.texture_paths[texture_ids[i]], blocks.widths[i], blocks.heights[i], container_size,
+                container_size);
+        }
+    }
+
+    PackingResult packing = search_for_best_packing(blocks, container_size, settings.packing_search_candidates);
 
-            currently_created_packed_texture_containers.push_back(pt);
+    std::vector<PackedTextureContainer> currently_created_packed_texture_containers(packing.packers.size());
+    for (size_t i = 0; i < packing.packers.size(); ++i) {
+        currently_created_packed_texture_containers[i].packer = packing.packers[i];
+    }
+
+    // blocks go into their containers in packing order so the containers list them in the order they were placed
+    for (size_t block_index : packing.packing_order) {
+        const auto &placement = packing.placements[block_index];
+        if (!placement) {
+            continue;
         }
+        size_t id = texture_ids[block_index];
+        texture_blocks.placements[id] = placement;
+        currently_created_packed_texture_containers[placement->container_index].texture_ids.push_back(id);
+    }
+
+    size_t num_allocations = get_num_allocations() - num_allocations_at_start;
+
+    global_logger.info("Packed with block ordering {} and split rule {}: {} containers at {:.2f}% occupancy",
+                       to_string(packing.strategy.ordering), to_string(packing.strategy.split_rule),
+                       packing.num_containers(), packing.occupancy * 100.0);
+    if constexpr (allocation_counting_enabled) {
+        global_logger.info("Packing {} texture blocks made {} heap allocations", texture_ids.size(), num_allocations);
     }
 
     // Summary of results
@@ -281,64 +804,115 @@ TexturePacker::pack_texture_blocks_into_containers(std::vector<TextureBlock> &te
     for (size_t i = 0; i < currently_created_packed_texture_containers.size(); ++i) {
         const auto &container = currently_created_packed_texture_containers[i];
         global_logger.info("Container {}:", i);
-        global_logger.info("  - Number of packed blocks: {}", container.packed_texture_blocks.size());
-        for (const auto &block : container.packed_texture_blocks) {
-            global_logger.info("    - TextureBlock: {}\n        Dimensions: {}x{}", block.texture_path, block.block.w,
-                               block.block.h);
-            if (block.block.packed_placement) {
-                const auto &placement = block.block.packed_placement.value();
-                global_logger.info("        Placement: ({}, {})", placement.top_left_x, placement.top_left_y);
-            } else {
-                global_logger.info("        Placement: Not packed");
-            }
+        global_logger.info("  - Number of packed blocks: {}", container.texture_ids.size());
+        for (size_t id : container.texture_ids) {
+            const BlockPlacement &placement = texture_blocks.placements[id].value();
+            global_logger.info("    - TextureBlock: {}\n        Dimensions: {}x{}\n        Placement: ({}, {})",
+                               texture_blocks.texture_paths[id], texture_blocks.sizes.widths[id],
+                               texture_blocks.sizes.heights[id], placement.top_left_x, placement.top_left_y);
         }
     }
 
     return currently_created_packed_texture_containers;
 }
 
-std::vector<TextureBlock>
-TexturePacker::construct_texture_blocks_from_texture_paths(const std::vector<std::string> &texture_paths) {
-    std::vector<TextureBlock> texture_blocks;
-
-    for (const auto &file_path : texture_paths) {
-        // Load image using stb_image
-        int width, height, channels;
-
-        // we're throwing away the image data here, because we only need width and height really
-        unsigned char *img_data = stbi_load(file_path.c_str(), &width, &height, &channels, 0);
-        if (img_data) {
-            // Example condition for processing the image
-            if (true) {
-                std::map<std::string, std::map<std::string, float>> subtextures;
-
-                // Check for associated JSON file
-                std::string json_path = file_path.substr(0, file_path.find_last_of('.')) + ".json";
-                std::ifstream json_file(json_path);
-
-                if (json_file.is_open()) {
-                    nlohmann::json json;
-                    json_file >> json;
-                    if (json.contains("sub_textures")) {
-                        subtextures = json["sub_textures"];
-                    }
-                }
+size_t TextureBlockTable::add_texture(std::string texture_path, int width, int height, int num_channels,
+                                      int priority) {
+    sizes.push_back(width, height);
+    source_sizes.push_back(width, height);
+    scales.push_back(1.0f);
+    priorities.push_back(priority);
+    this->num_channels.push_back(num_channels);
+    placements.emplace_back();
+    texture_paths.push_back(std::move(texture_path));
+    sub_texture_offsets.push_back(sub_texture_records.size());
+    return texture_paths.size() - 1;
+}
 
-                global_logger.info("Found texture {} with dimensions {}x{}", file_path, width, height);
+void TextureBlockTable::set_scale(size_t texture_id, float scale) {
+    scales[texture_id] = scale;
+    // the epsilon keeps float error from turning 200 * 0.5 into 99
+    sizes.widths[texture_id] = std::max(1, static_cast<int>(source_sizes.widths[texture_id] * scale + 0.001f));
+    sizes.heights[texture_id] = std::max(1, static_cast<int>(source_sizes.heights[texture_id] * scale + 0.001f));
+}
 
-                // here the data gets saved into new memory now.
-                std::vector<unsigned char> image_data(img_data, img_data + width * height * channels);
+void TextureBlockTable::add_sub_texture(SubTextureRecord record) {
+    sub_texture_records.push_back(std::move(record));
+    sub_texture_offsets.back() = sub_texture_records.size();
+}
 
-                // Create the TextureBlock
-                TextureBlock tb(width, height, file_path);
-                tb.subtextures = subtextures;
-                texture_blocks.push_back(tb);
+std::span<const SubTextureRecord> TextureBlockTable::get_sub_textures(size_t texture_id) const {
+    size_t begin = sub_texture_offsets[texture_id];
+    size_t end = sub_texture_offsets[texture_id + 1];
+    return std::span<const SubTextureRecord>(sub_texture_records).subspan(begin, end - begin);
+}
 
-                stbi_image_free(img_data);
-            } else {
-                // Example future check for power-of-two dimensions
-                global_logger.warn("The texture {} did not have power-of-two dimensions", file_path);
-                stbi_image_free(img_data);
+BlockSizes TextureBlockTable::sizes_of(const std::vector<size_t> &texture_ids) const {
+    BlockSizes block_sizes;
+    block_sizes.reserve(texture_ids.size());
+    for (size_t id : texture_ids) {
+        block_sizes.push_back(sizes.widths[id], sizes.heights[id]);
+    }
+    return block_sizes;
+}
+
+/**
+ * @brief The priority of the most specific directory in `directory_priorities` that contains the file, or zero.
+ */
+int directory_priority_of(const std::filesystem::path &file_path,
+                          const std::map<std::filesystem::path, int> &directory_priorities) {
+    int priority = 0;
+    std::ptrdiff_t deepest_directory_depth = -1;
+    std::filesystem::path normalized_file_path = file_path.lexically_normal();
+
+    for (const auto &[directory, directory_priority] : directory_priorities) {
+        std::filesystem::path normalized_directory = directory.lexically_normal();
+        if (!normalized_directory.has_filename()) {
+            normalized_directory = normalized_directory.parent_path();
+        }
+
+        std::filesystem::path relative_path = normalized_file_path.lexically_relative(normalized_directory);
+        if (relative_path.empty() || *relative_path.begin() == "..") {
+            continue;
+        }
+
+        std::ptrdiff_t directory_depth = std::distance(normalized_directory.begin(), normalized_directory.end());
+        if (directory_depth > deepest_directory_depth) {
+            deepest_directory_depth = directory_depth;
+            priority = directory_priority;
+        }
+    }
+    return priority;
+}
+
+TextureBlockTable
+TexturePacker::construct_texture_blocks_from_texture_paths(const std::vector<std::string> &texture_paths) {
+    TextureBlockTable texture_blocks;
+
+    // only the headers are needed to know the size of each texture, so no pixels are decoded here
+    std::vector<ImageInfo> image_infos = read_image_infos(texture_paths);
+    // reused for every texture so that its sub-texture list keeps its capacity
+    SidecarRecord sidecar;
+
+    for (size_t i = 0; i < texture_paths.size(); ++i) {
+        const std::string &file_path = texture_paths[i];
+        const ImageInfo &image_info = image_infos[i];
+
+        if (image_info.valid) {
+            global_logger.info("Found texture {} with dimensions {}x{}", file_path, image_info.width,
+                               image_info.height);
+            size_t id = texture_blocks.add_texture(file_path, image_info.width, image_info.height,
+                                                   image_info.channels_in_file,
+                                                   directory_priority_of(file_path, settings.directory_priorities));
+
+            // Check for associated JSON file
+            std::string json_path = file_path.substr(0, file_path.find_last_of('.')) + ".json";
+
+            if (read_sidecar_metadata(json_path, sidecar)) {
+                texture_blocks.priorities[id] = sidecar.priority.value_or(texture_blocks.priorities[id]);
+                for (const auto &record : sidecar.sub_textures) {
+                    texture_blocks.add_sub_texture(record);
+                }
             }
         } else {
             global_logger.error("Failed to load texture: {}", file_path);
@@ -353,84 +927,536 @@ void TexturePacker::regenerate(const std::vector<std::string> &new_texture_paths
     currently_held_texture_paths.insert(currently_held_texture_paths.end(), new_texture_paths.begin(),
                                         new_texture_paths.end());
 
-    pack_textures(currently_held_texture_paths, this->output_dir, this->container_side_length);
+    // without a key the bake can't be checked later, so an older key mustn't vouch for it either
+    write_bake_key(output_dir, bake(currently_held_texture_paths, output_dir));
+    load_bake();
+}
 
-    // clear out anything data which was previously stored
-    file_path_to_packed_texture_info.clear();
-    texture_index_to_bounding_box.clear();
+std::string TexturePacker::bake(const std::vector<std::string> &texture_paths, const std::filesystem::path &bake_dir,
+                                std::string bake_key) {
+    if (settings.bake_cache_directory.empty()) {
+        pack_textures(texture_paths, bake_dir, this->max_container_side_length);
+        return bake_key;
+    }
 
-    std::filesystem::path packed_texture_json_path =
-        std::filesystem::path("assets") / "packed_textures" / "packed_textures.json";
-    std::filesystem::path texture_directory = std::filesystem::path("assets") / "packed_textures";
+    BakeCache bake_cache(settings.bake_cache_directory, settings.bake_cache_max_size_bytes);
+    if (bake_key.empty()) {
+        bake_key = compute_bake_key(texture_paths, this->max_container_side_length);
+    }
+    if (!bake_cache.fetch(bake_key, bake_dir, list_bake_bundle_filenames)) {
+        pack_textures(texture_paths, bake_dir, this->max_container_side_length);
+        bake_cache.store(bake_key, bake_dir, list_bake_bundle_filenames(bake_dir));
+    }
+    return bake_key;
+}
 
-    std::vector<std::filesystem::path> packed_texture_paths =
-        fs_utils::list_files_matching_regex(texture_directory, "packed_texture_\\d+\\.png");
-    std::sort(packed_texture_paths.begin(), packed_texture_paths.end());
+void TexturePacker::bake_in_background() {
+    try {
+        std::vector<std::string> texture_paths = get_texture_paths(textures_directory, output_dir);
+        std::string bake_key = compute_bake_key(texture_paths, this->max_container_side_length);
+
+        if (read_bake_key(output_dir) == bake_key) {
+            global_logger.info("The bake in {} is up to date", output_dir.string());
+            enqueue_gl_work([this, texture_paths = std::move(texture_paths)] {
+                std::exception_ptr error;
+                try {
+                    // the key only vouches for the files, if they couldn't be served when preloading they are loaded
+                    // again here so the error reaches the ready future instead of an empty lookup being published
+                    if (!previous_bake_loaded) {
+                        load_bake();
+                    }
+                    currently_held_texture_paths = texture_paths;
+                } catch (...) {
+                    error = std::current_exception();
+                }
+                mark_ready(error);
+            });
+        } else {
+            // the served bake is read on the gl thread meanwhile, so the new one can't be written over it in place
+            std::filesystem::path staging_dir = output_dir / staging_directory_name;
+            std::filesystem::remove_all(staging_dir);
+            std::filesystem::create_directories(staging_dir);
+            write_bake_key(staging_dir, bake(texture_paths, staging_dir, bake_key));
+
+            enqueue_gl_work([this, texture_paths = std::move(texture_paths), staging_dir] {
+                std::exception_ptr error;
+                try {
+                    install_staged_bake(staging_dir, output_dir);
+                    currently_held_texture_paths = texture_paths;
+                    load_bake();
+                } catch (...) {
+                    error = std::current_exception();
+                }
+                mark_ready(error);
+            });
+        }
+    } catch (...) {
+        enqueue_gl_work([this, error = std::current_exception()] { mark_ready(error); });
+    }
 
-    // I think this uniform doesn't have to be bound because its texture unit is 0 and it works straight away?
-    glActiveTexture(GL_TEXTURE0);
-    glGenTextures(1, &packed_texture_array_gl_id);
-    glBindTexture(GL_TEXTURE_2D_ARRAY, packed_texture_array_gl_id);
-
-    int width, height, nrChannels;
-    unsigned char *data;
-    int num_layers = static_cast<int>(packed_texture_paths.size());
-
-    // Assuming all textures are the same size; load the first texture to get dimensions
-    global_logger.info("about to load texture: {}", packed_texture_paths[0].string());
-    std::string first_matching_texture_path = packed_texture_paths[0].string();
-    data = stbi_load(first_matching_texture_path.c_str(), &width, &height, &nrChannels, STBI_rgb_alpha);
-    if (!data) {
-        global_logger.error("Failed to load texture: {}", packed_texture_paths[0].string());
+    background_bake_finished.set_value();
+}
+
+void TexturePacker::enqueue_gl_work(std::function<void()> work) {
+    std::lock_guard<std::mutex> lock(pending_gl_work_mutex);
+    pending_gl_work.push_back(std::move(work));
+}
+
+void TexturePacker::process_pending_gl_work() {
+    std::vector<std::function<void()>> gl_work;
+    {
+        std::lock_guard<std::mutex> lock(pending_gl_work_mutex);
+        gl_work.swap(pending_gl_work);
+    }
+    for (auto &work : gl_work) {
+        work();
+    }
+}
+
+void TexturePacker::mark_ready(std::exception_ptr error) {
+    std::vector<std::function<void()>> callbacks;
+    std::map<std::string, std::vector<std::promise<void>>> unresolved_texture_waiters;
+    {
+        std::lock_guard<std::mutex> lock(readiness_mutex);
+        if (ready) {
+            return;
+        }
+        ready = true;
+        callbacks.swap(ready_callbacks);
+        unresolved_texture_waiters.swap(texture_waiters);
+    }
+
+    if (error) {
+        ready_promise.set_exception(error);
+    } else {
+        ready_promise.set_value();
+    }
+
+    // the up to date bake is published, so anything still waited on isn't coming
+    for (auto &[file_path, waiters] : unresolved_texture_waiters) {
+        std::exception_ptr waiter_error =
+            error ? error : std::make_exception_ptr(std::runtime_error("Texture path not found: " + file_path));
+        for (auto &waiter : waiters) {
+            waiter.set_exception(waiter_error);
+        }
+    }
+
+    // a throwing callback mustn't keep the others from running or escape process_pending_gl_work
+    for (auto &callback : callbacks) {
+        try {
+            callback();
+        } catch (const std::exception &e) {
+            global_logger.error("An on_ready callback threw: {}", e.what());
+        } catch (...) {
+            global_logger.error("An on_ready callback threw");
+        }
+    }
+}
+
+std::shared_future<void> TexturePacker::get_ready_future() const { return ready_future; }
+
+void TexturePacker::on_ready(std::function<void()> callback) {
+    {
+        std::lock_guard<std::mutex> lock(readiness_mutex);
+        if (!ready) {
+            ready_callbacks.push_back(std::move(callback));
+            return;
+        }
+    }
+    callback();
+}
+
+std::shared_future<void> TexturePacker::await_texture(const std::string &file_path) {
+    std::promise<void> waiter;
+    std::shared_future<void> future = waiter.get_future().share();
+
+    // publishing holds the same lock, so the current snapshot can't be retired while it is looked at here
+    std::lock_guard<std::mutex> lock(readiness_mutex);
+    if (current_packed_texture_lookup.load()->get_file_path_to_packed_texture_info().contains(file_path)) {
+        waiter.set_value();
+    } else if (ready) {
+        waiter.set_exception(std::make_exception_ptr(std::runtime_error("Texture path not found: " + file_path)));
+    } else {
+        texture_waiters[file_path].push_back(std::move(waiter));
+    }
+    return future;
+}
+
+void TexturePacker::load_bake() {
+    std::filesystem::path packed_texture_json_path = output_dir / "packed_textures.json";
+
+    // everything is read and checked into locals first, so a bake that is rejected leaves the loaded one untouched
+    // the layer size of each format comes from the metadata, a trimmed last container is smaller than the rest
+    std::map<TextureFormat, PackedTextureArray> new_format_to_packed_texture_array;
+    std::map<std::string, PackedTextureSubTexture> file_path_to_packed_texture_info =
+        read_file_path_to_packed_texture_map(packed_texture_json_path, new_format_to_packed_texture_array);
+    std::vector<glm::vec4> texture_index_to_bounding_box =
+        populate_texture_index_to_bounding_box(file_path_to_packed_texture_info, new_format_to_packed_texture_array);
+
+    // metadata without formats still reads as an rgba8 array, so it is the containers that tell if anything was packed
+    int num_containers = 0;
+    for (const auto &[format, packed_texture_array] : new_format_to_packed_texture_array) {
+        num_containers += packed_texture_array.num_containers;
+    }
+    if (num_containers == 0) {
+        throw std::runtime_error("No packed textures were found in " + output_dir.string());
+    }
+
+    AtlasReport new_atlas_report =
+        build_atlas_report(file_path_to_packed_texture_info, new_format_to_packed_texture_array);
+    global_logger.info(
+        "The bake uses {} containers at {:.2f}% occupancy and takes {} bytes of gpu memory",
+        new_atlas_report.containers.size(),
+        100.0 * new_atlas_report.used_area / std::max(1LL, new_atlas_report.used_area + new_atlas_report.free_area),
+        new_atlas_report.total_gpu_bytes);
+    // written even when the bake is rejected below, it is what tells why
+    if (!settings.atlas_report_path.empty()) {
+        new_atlas_report.write_json(settings.atlas_report_path);
+    }
+
+    if (settings.gpu_memory_budget_bytes != 0 &&
+        new_atlas_report.total_gpu_bytes > settings.gpu_memory_budget_bytes) {
+        std::string message = "The packed textures take " + std::to_string(new_atlas_report.total_gpu_bytes) +
+                              " bytes of gpu memory, which is over the budget of " +
+                              std::to_string(settings.gpu_memory_budget_bytes) + " bytes";
+        if (settings.gpu_memory_budget_action == BudgetAction::fail) {
+            throw std::runtime_error(message);
+        }
+        global_logger.warn("{}", message);
+    }
+
+    // a buffer texture is addressed by a single index, so every box has to fit in it or the indices past it break
+    GLint max_texture_buffer_size = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &max_texture_buffer_size);
+    if (texture_index_to_bounding_box.size() > static_cast<size_t>(max_texture_buffer_size)) {
+        throw std::runtime_error(std::to_string(texture_index_to_bounding_box.size()) +
+                                 " bounding boxes don't fit in a buffer texture, which can hold at most " +
+                                 std::to_string(max_texture_buffer_size) + " texels");
+    }
+
+    // the loaded arrays stay bound until the new ones are all on the gpu, if an upload throws only the new ones go
+    std::map<TextureFormat, std::unique_ptr<LayerResidencyManager>> new_format_to_layer_residency;
+    try {
+        ImageLoadingPool image_loading_pool(settings.image_loading);
+        for (auto &[format, packed_texture_array] : new_format_to_packed_texture_array) {
+            if (auto layer_residency = upload_packed_texture_array(packed_texture_array, image_loading_pool)) {
+                new_format_to_layer_residency[format] = std::move(layer_residency);
+            }
+        }
+    } catch (...) {
+        new_format_to_layer_residency.clear();
+        delete_packed_texture_arrays(new_format_to_packed_texture_array);
+        throw;
+    }
+
+    // every check passed, from here on the new bake replaces the loaded one
+    format_to_layer_residency = std::move(new_format_to_layer_residency);
+    delete_packed_texture_arrays(format_to_packed_texture_array);
+    atlas_report = std::move(new_atlas_report);
+    format_to_packed_texture_array = std::move(new_format_to_packed_texture_array);
+    if (format_to_packed_texture_array.contains(TextureFormat::rgba8)) {
+        container_side_length = format_to_packed_texture_array.at(TextureFormat::rgba8).container_side_length;
+    }
+
+    // done loading up packed textures, starting to load up bounding boxes. the padding past the last box is only
+    // there so the buffer doesn't have to be reallocated on every bake, it is never read
+    size_t size = std::min(bounding_box_buffer_size(texture_index_to_bounding_box.size()),
+                           static_cast<size_t>(max_texture_buffer_size));
+    std::vector<glm::vec4> bounding_boxes_to_upload = texture_index_to_bounding_box;
+    bounding_boxes_to_upload.resize(size, glm::vec4(0.0f));
+    GLsizeiptr num_bytes = static_cast<GLsizeiptr>(size * sizeof(glm::vec4));
+
+    if (packed_texture_bounding_boxes_buffer_gl_id == 0) {
+        glGenBuffers(1, &packed_texture_bounding_boxes_buffer_gl_id);
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, packed_texture_bounding_boxes_buffer_gl_id);
+
+    // the storage is only reallocated when the number of entries crosses a power of two
+    if (size != bounding_box_buffer_capacity) {
+        glBufferData(GL_TEXTURE_BUFFER, num_bytes, bounding_boxes_to_upload.data(), GL_DYNAMIC_DRAW);
+        bounding_box_buffer_capacity = size;
+    } else {
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, num_bytes, bounding_boxes_to_upload.data());
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    glActiveTexture(GL_TEXTURE1);
+    if (packed_texture_bounding_boxes_gl_id == 0) {
+        glGenTextures(1, &packed_texture_bounding_boxes_gl_id);
+    }
+    glBindTexture(GL_TEXTURE_BUFFER, packed_texture_bounding_boxes_gl_id);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, packed_texture_bounding_boxes_buffer_gl_id);
+
+    // everything the new snapshot refers to is on the gpu now, so readers can switch over to it
+    {
+        std::lock_guard<std::mutex> lock(readiness_mutex);
+        publish_packed_texture_lookup(std::make_shared<const PackedTextureLookup>(
+            std::move(file_path_to_packed_texture_info), std::move(texture_index_to_bounding_box)));
+
+        const auto &published_textures = current_packed_texture_lookup.load()->get_file_path_to_packed_texture_info();
+        for (auto it = texture_waiters.begin(); it != texture_waiters.end();) {
+            if (!published_textures.contains(it->first)) {
+                ++it;
+                continue;
+            }
+            for (auto &waiter : it->second) {
+                waiter.set_value();
+            }
+            it = texture_waiters.erase(it);
+        }
+    }
+
+    if (!settings.texture_id_header_path.empty()) {
+        write_texture_id_header(settings.texture_id_header_path);
+    }
+}
+
+/// keywords and alternative tokens, which can't be used as identifiers
+const std::unordered_set<std::string> cpp_keywords = {
+    "alignas", "alignof", "and", "and_eq", "asm", "auto", "bitand", "bitor", "bool", "break", "case", "catch", "char",
+    "char8_t", "char16_t", "char32_t", "class", "compl", "concept", "const", "consteval", "constexpr", "constinit",
+    "const_cast", "continue", "co_await", "co_return", "co_yield", "decltype", "default", "delete", "do", "double",
+    "dynamic_cast", "else", "enum", "explicit", "export", "extern", "false", "float", "for", "friend", "goto", "if",
+    "inline", "int", "long", "mutable", "namespace", "new", "noexcept", "not", "not_eq", "nullptr", "operator", "or",
+    "or_eq", "private", "protected", "public", "register", "reinterpret_cast", "requires", "return", "short", "signed",
+    "sizeof", "static", "static_assert", "static_cast", "struct", "switch", "template", "this", "thread_local", "throw",
+    "true", "try", "typedef", "typeid", "typename", "union", "unsigned", "using", "virtual", "void", "volatile",
+    "wchar_t", "while", "xor", "xor_eq",
+};
+
+/**
+ * @brief Turns a path or sub-texture name into a valid C++ identifier which isn't in `used_identifiers` yet.
+ *
+ * Keywords get a trailing underscore, and neither a leading underscore nor two underscores in a row are produced,
+ * since those identifiers are reserved for the implementation.
+ */
+std::string make_unique_identifier(const std::string &name, std::set<std::string> &used_identifiers) {
+    std::string identifier;
+    for (char c : name) {
+        char identifier_char = std::isalnum(static_cast<unsigned char>(c)) ? c : '_';
+        if (identifier_char != '_' || identifier.empty() || identifier.back() != '_') {
+            identifier += identifier_char;
+        }
+    }
+    if (identifier.empty() || identifier[0] == '_' || std::isdigit(static_cast<unsigned char>(identifier[0]))) {
+        identifier = identifier.starts_with('_') ? "t" + identifier : "t_" + identifier;
+    }
+    if (cpp_keywords.contains(identifier)) {
+        identifier += "_";
+    }
+
+    // a trailing underscore already separates the suffix
+    std::string separator = identifier.ends_with('_') ? "" : "_";
+    std::string unique_identifier = identifier;
+    for (int suffix = 2; used_identifiers.contains(unique_identifier); ++suffix) {
+        unique_identifier = identifier + separator + std::to_string(suffix);
+    }
+    used_identifiers.insert(unique_identifier);
+    return unique_identifier;
+}
+
+std::string to_header_rect(const PackedTextureSubTexture &sub_texture) {
+    // texture_coordinates are top right, bottom right, bottom left, top left
+    const glm::vec2 &uv_min = sub_texture.texture_coordinates[3];
+    const glm::vec2 &uv_max = sub_texture.texture_coordinates[1];
+
+    std::ostringstream rect;
+    // showpoint so that every float literal has a decimal point, 0f isn't valid but 0.00000000f is
+    rect << std::showpoint << std::setprecision(9) << "{" << sub_texture.packed_texture_index
+         << ", Format::" << to_string(sub_texture.format) << ", " << sub_texture.packed_texture_bounding_box_index
+         << ", "
+         << sub_texture.top_left_x << ", " << sub_texture.top_left_y << ", " << sub_texture.width << ", "
+         << sub_texture.height << ", " << uv_min.x << "f, " << uv_min.y << "f, " << uv_max.x << "f, " << uv_max.y
+         << "f}";
+    return rect.str();
+}
+
+void TexturePacker::write_texture_id_header(const std::filesystem::path &header_path) {
+    std::shared_ptr<const PackedTextureLookup> lookup = get_packed_texture_lookup();
+    const auto &file_path_to_packed_texture_info = lookup->get_file_path_to_packed_texture_info();
+
+    std::ostringstream texture_ids;
+    std::ostringstream sub_texture_ids;
+    std::ostringstream rects;
+    std::ostringstream paths;
+
+    // the texture ids share the namespace with everything else the header declares
+    std::set<std::string> used_texture_identifiers = {"Format",   "PackedTextureRect", "TextureId", "num_textures",
+                                                      "num_ids",  "sub_textures",      "rects",     "paths"};
+    int id = 0;
+
+    // textures come first so that their ids are contiguous, then every sprite sheet's entries follow
+    for (const auto &[file_path, sub_texture] : file_path_to_packed_texture_info) {
+        texture_ids << "    " << make_unique_identifier(file_path, used_texture_identifiers) << " = " << id << ",\n";
+        rects << "    " << to_header_rect(sub_texture) << ",\n";
+        paths << "    " << nlohmann::json(file_path).dump() << ",\n";
+        id++;
+    }
+    int num_textures = id;
+
+    std::set<std::string> used_sheet_identifiers;
+    std::vector<std::string> sub_texture_names;
+    for (const auto &[file_path, sub_texture] : file_path_to_packed_texture_info) {
+        if (sub_texture.sub_atlas.empty()) {
+            continue;
+        }
+
+        std::string sheet_identifier = make_unique_identifier(file_path, used_sheet_identifiers);
+        sub_texture_ids << "namespace " << sheet_identifier << " {\n"
+                        << "enum SubTextureId : int {\n";
+        std::set<std::string> used_sub_texture_identifiers = {"SubTextureId"};
+        // entries nested deeper than the sheet itself are named after the whole way down to them
+        for_each_sub_atlas_entry(sub_texture, sub_texture_names, [&](const std::vector<std::string> &names,
+                                                                     const PackedTextureSubTexture &entry) {
+            std::string name = names[0];
+            for (size_t i = 1; i < names.size(); ++i) {
+                name += ":" + names[i];
+            }
+            sub_texture_ids << "    " << make_unique_identifier(name, used_sub_texture_identifiers) << " = " << id
+                            << ",\n";
+            rects << "    " << to_header_rect(entry) << ",\n";
+            paths << "    " << nlohmann::json(file_path + ":" + name).dump() << ",\n";
+            id++;
+        });
+        sub_texture_ids << "};\n} // namespace " << sheet_identifier << "\n\n";
+    }
+
+    std::ostringstream header;
+    header << "// generated by TexturePacker::write_texture_id_header, do not edit\n"
+           << "#ifndef PACKED_TEXTURE_IDS_HPP\n"
+           << "#define PACKED_TEXTURE_IDS_HPP\n\n"
+           << "namespace packed_texture_ids {\n\n"
+           << "enum class Format { r8, rg8, rgba8 };\n\n"
+           << "struct PackedTextureRect {\n"
+           << "    int container_index;\n"
+           << "    Format format;\n"
+           << "    // the texel holding this rect's bounding box, ids and bounding box indices are the same\n"
+           << "    int bounding_box_index;\n"
+           << "    int x, y, width, height;\n"
+           << "    float u_min, v_min, u_max, v_max;\n"
+           << "};\n\n"
+           << "enum TextureId : int {\n"
+           << texture_ids.str() << "};\n\n"
+           << "inline constexpr int num_textures = " << num_textures << ";\n"
+           << "inline constexpr int num_ids = " << id << ";\n\n"
+           << "namespace sub_textures {\n\n"
+           << sub_texture_ids.str() << "} // namespace sub_textures\n\n"
+           << "inline constexpr PackedTextureRect rects[num_ids + 1] = {\n"
+           << rects.str() << "    {}};\n\n"
+           << "inline constexpr const char *paths[num_ids + 1] = {\n"
+           << paths.str() << "    nullptr};\n\n"
+           << "} // namespace packed_texture_ids\n\n"
+           << "#endif // PACKED_TEXTURE_IDS_HPP\n";
+
+    std::ifstream existing_header(header_path);
+    std::stringstream existing_contents;
+    existing_contents << existing_header.rdbuf();
+    if (existing_header.is_open() && existing_contents.str() == header.str()) {
+        global_logger.info("Texture id header {} is already up to date", header_path.string());
         return;
     }
-    stbi_image_free(data);
+    existing_header.close();
 
-    set_file_path_to_packed_texture_map(packed_texture_json_path, width, height);
-    populate_texture_index_to_bounding_box();
-    std::map<std::string, PackedTextureSubTexture> file_path_to_packed_texture_info;
+    std::ofstream header_output(header_path);
+    header_output << header.str();
+    global_logger.info("Wrote {} texture ids to {}", id, header_path.string());
+}
+
+std::unique_ptr<LayerResidencyManager>
+TexturePacker::upload_packed_texture_array(PackedTextureArray &packed_texture_array,
+                                           ImageLoadingPool &image_loading_pool) {
+    TextureFormat format = packed_texture_array.format;
+    int channels = num_channels(format);
+    GLint internal_format = format == TextureFormat::r8 ? GL_R8 : format == TextureFormat::rg8 ? GL_RG8 : GL_RGBA8;
+    GLenum pixel_format = format == TextureFormat::r8 ? GL_RED : format == TextureFormat::rg8 ? GL_RG : GL_RGBA;
+
+    // I think this uniform doesn't have to be bound because its texture unit is 0 and it works straight away?
+    glActiveTexture(texture_unit_of_format(format));
+    glGenTextures(1, &packed_texture_array.gl_id);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, packed_texture_array.gl_id);
 
-    // initialize the 2d texture array
-    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, width, height, num_layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    int num_layers = packed_texture_array.num_containers;
+
+    // initialize the 2d texture array, when paging it only has room for the resident layers
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, internal_format, packed_texture_array.container_side_length,
+                 packed_texture_array.container_side_length, num_gpu_layers(packed_texture_array), 0, pixel_format,
+                 GL_UNSIGNED_BYTE, nullptr);
 
     glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
-    // Load each texture layer
+    // grayscale textures read back as (l, l, l, 1) and grayscale with alpha as (l, l, l, a), so the same shader code
+    // can sample every format
+    if (format == TextureFormat::r8) {
+        GLint swizzle[] = {GL_RED, GL_RED, GL_RED, GL_ONE};
+        glTexParameteriv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+    } else if (format == TextureFormat::rg8) {
+        GLint swizzle[] = {GL_RED, GL_RED, GL_RED, GL_GREEN};
+        glTexParameteriv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+    }
+
+    std::vector<std::string> packed_texture_paths;
     for (int i = 0; i < num_layers; i++) {
-        std::string current_packed_texture_path = packed_texture_paths[i].string();
-        data = stbi_load(current_packed_texture_path.c_str(), &width, &height, &nrChannels, STBI_rgb_alpha);
-        if (data) {
-            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, data);
-            stbi_image_free(data);
+        packed_texture_paths.push_back((output_dir / packed_texture_filename(format, i)).string());
+    }
+
+    // too many containers to keep all of them on the gpu, so cpu copies are kept and paged in when requested
+    if (num_gpu_layers(packed_texture_array) < num_layers) {
+        std::vector<CpuLayer> cpu_layers(num_layers);
+        if (settings.keep_decoded_layer_copies) {
+            image_loading_pool.load_images(
+                packed_texture_paths, channels,
+                [&](LoadedImage &&layer) {
+                    CpuLayer &cpu_layer = cpu_layers[layer.index];
+                    if (!layer.pixels) {
+                        global_logger.error("Failed to load texture: {}", packed_texture_paths[layer.index]);
+                        return;
+                    }
+                    cpu_layer.width = layer.width;
+                    cpu_layer.height = layer.height;
+                    cpu_layer.pixels.assign(layer.pixels.get(),
+                                            layer.pixels.get() + static_cast<size_t>(layer.width) * layer.height *
+                                                                     channels);
+                });
         } else {
-            std::cerr << "Failed to load texture: " << current_packed_texture_path << std::endl;
+            parallel_for_each_index(cpu_layers.size(), [&](size_t i) {
+                cpu_layers[i].encoded = read_file_bytes(packed_texture_paths[i]);
+            });
         }
-    }
-    // done loading up packed textures, starting to load up bounding boxes.
-    glActiveTexture(GL_TEXTURE1);
-    glGenTextures(1, &packed_texture_bounding_boxes_gl_id);
-    glBindTexture(GL_TEXTURE_1D, packed_texture_bounding_boxes_gl_id);
 
-    int MAX_NUM_TEXTURES = 1024;
-    // Check if the texture data exceeds the maximum texture size
-    if (texture_index_to_bounding_box.size() > MAX_NUM_TEXTURES) {
-        std::cerr << "Error: Too many textures, exceeds MAX_NUM_TEXTURES." << std::endl;
-        // Resize to fit the maximum size
-        texture_index_to_bounding_box.resize(MAX_NUM_TEXTURES);
-    } else if (texture_index_to_bounding_box.size() < MAX_NUM_TEXTURES) {
-        // Resize to fit the maximum size and fill the new space with zeros
-        texture_index_to_bounding_box.resize(MAX_NUM_TEXTURES, glm::vec4(0.0f));
+        global_logger.info("Paging {} {} containers through {} gpu layers", num_layers, to_string(format),
+                           num_gpu_layers(packed_texture_array));
+        auto backend =
+            std::make_unique<GLLayerUploadBackend>(packed_texture_array.gl_id, texture_unit_of_format(format),
+                                                   pixel_format, indirection_table_unit_of_format(format));
+        auto layer_residency = std::make_unique<LayerResidencyManager>(
+            std::move(cpu_layers), channels, num_gpu_layers(packed_texture_array), std::move(backend),
+            settings.max_layer_uploads_per_frame);
+        // nothing is resident yet, but shaders need a table to read from straight away
+        layer_residency->update();
+        return layer_residency;
     }
 
-    glTexImage1D(GL_TEXTURE_1D, 0, GL_RGBA32F, MAX_NUM_TEXTURES, 0, GL_RGBA, GL_FLOAT,
-                 texture_index_to_bounding_box.data());
+    // rows of one and two channel images aren't necessarily a multiple of four bytes long
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    // Load each texture layer, decoding happens on worker threads and the uploads on this one
+    image_loading_pool.load_images(
+        packed_texture_paths, channels,
+        [&](LoadedImage &&layer) {
+            int i = static_cast<int>(layer.index);
+            if (layer.pixels) {
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, layer.width, layer.height, 1, pixel_format,
+                                GL_UNSIGNED_BYTE, layer.pixels.get());
+            } else {
+                global_logger.error("Failed to load texture: {}", packed_texture_paths[i]);
+            }
+        });
 
-    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    return nullptr;
 }
 
 std::vector<glm::vec2> compute_texture_coordinates(float x, float y, float width, float height, int atlas_width,
@@ -450,102 +1476,280 @@ std::vector<glm::vec2> compute_texture_coordinates(float x, float y, float width
     };
 }
 
-PackedTextureSubTexture TexturePacker::parse_sub_texture(const nlohmann::json &sub_texture_json, int atlas_width,
-                                                         int atlas_height, int texture_index) {
+PackedTextureSubTexture TexturePacker::parse_sub_texture(const PackedTextureRecord &texture_record) {
     PackedTextureSubTexture sub_texture;
-    int top_left_x = sub_texture_json.at("x").get<int>();
-    int top_left_y = sub_texture_json.at("y").get<int>();
-    int width = sub_texture_json.at("width").get<int>();
-    int height = sub_texture_json.at("height").get<int>();
-    int packed_texture_index = sub_texture_json.at("container_index").get<unsigned int>();
-
-    // regular images packed in
-    sub_texture.texture_coordinates =
-        compute_texture_coordinates(top_left_x, top_left_y, width, height, atlas_width, atlas_height);
-    sub_texture.packed_texture_bounding_box_index = texture_index;
-    sub_texture.packed_texture_index = packed_texture_index;
-    sub_texture.top_left_x = top_left_x;
-    sub_texture.top_left_y = top_left_y;
-    sub_texture.width = width;
-    sub_texture.height = height;
-
-    // sub texture is a texture atlas
-    // things that were texture atlases, that also got packed in (one level of recursion)
-    if (sub_texture_json.contains("sub_textures")) {
-        for (auto &[subtexture_name, sub_atlas_json] : sub_texture_json.at("sub_textures").items()) {
-            float sub_top_left_x = sub_atlas_json.at("x").get<int>();
-            float sub_top_left_y = sub_atlas_json.at("y").get<int>();
-            float sub_width = sub_atlas_json.at("width").get<int>();
-            float sub_height = sub_atlas_json.at("height").get<int>();
-
-            PackedTextureSubTexture sub_atlas_sub_texture;
-            sub_atlas_sub_texture.top_left_x = sub_top_left_x;
-            sub_atlas_sub_texture.top_left_y = sub_top_left_y;
-            sub_atlas_sub_texture.packed_texture_index = packed_texture_index;
-            sub_atlas_sub_texture.texture_coordinates = compute_texture_coordinates(
-                sub_top_left_x, sub_top_left_y, sub_width, sub_height, atlas_width, atlas_height);
-            sub_atlas_sub_texture.width = sub_width;
-            sub_atlas_sub_texture.height = sub_height;
-            sub_texture.sub_atlas[subtexture_name] = sub_atlas_sub_texture;
-        }
+    sub_texture.format = texture_format_from_string(texture_record.format);
+    sub_texture.scale = texture_record.scale;
+    sub_texture.packed_texture_index = texture_record.container_index;
+    sub_texture.top_left_x = texture_record.x;
+    sub_texture.top_left_y = texture_record.y;
+    sub_texture.width = texture_record.width;
+    sub_texture.height = texture_record.height;
+
+    // sub texture is a texture atlas, whose entries can be atlases too
+    // the records are flattened with every parent first, so each one's node is kept to hang its children off of
+    std::vector<PackedTextureSubTexture *> nodes(texture_record.sub_textures.size());
+    for (size_t i = 0; i < texture_record.sub_textures.size(); ++i) {
+        const SubTextureRecord &record = texture_record.sub_textures[i];
+        auto &siblings = record.parent >= 0 ? nodes[record.parent]->sub_atlas : sub_texture.sub_atlas;
+        PackedTextureSubTexture &sub_atlas_sub_texture = siblings[record.name];
+        sub_atlas_sub_texture.top_left_x = record.x;
+        sub_atlas_sub_texture.top_left_y = record.y;
+        sub_atlas_sub_texture.packed_texture_index = sub_texture.packed_texture_index;
+        sub_atlas_sub_texture.format = sub_texture.format;
+        sub_atlas_sub_texture.scale = sub_texture.scale;
+        sub_atlas_sub_texture.width = record.width;
+        sub_atlas_sub_texture.height = record.height;
+        nodes[i] = &sub_atlas_sub_texture;
     }
 
     return sub_texture;
 }
 
-void TexturePacker::set_file_path_to_packed_texture_map(const std::filesystem::path &file_path,
-                                                        unsigned int atlas_width, unsigned int atlas_height) {
-    std::ifstream file(file_path);
-    nlohmann::json j;
-    file >> j;
+std::map<std::string, PackedTextureSubTexture> TexturePacker::read_file_path_to_packed_texture_map(
+    const std::filesystem::path &file_path,
+    std::map<TextureFormat, PackedTextureArray> &format_to_packed_texture_array) {
+    format_to_packed_texture_array.clear();
+    std::map<std::string, PackedTextureSubTexture> file_path_to_packed_texture_info;
+
+    // the entries go straight into the lookup table as they are streamed, without a json document in between
+    read_packed_textures_metadata(
+        file_path,
+        [&](const PackedFormatRecord &format_record) {
+            TextureFormat format = texture_format_from_string(format_record.format);
+            format_to_packed_texture_array[format] = {format, format_record.container_side_length,
+                                                      format_record.num_containers};
+        },
+        [&](const PackedTextureRecord &texture_record) {
+            file_path_to_packed_texture_info.insert_or_assign(texture_record.path, parse_sub_texture(texture_record));
+        });
+
+    if (format_to_packed_texture_array.empty()) {
+        // metadata written before formats were recorded is a single rgba8 array packed with the requested side length
+        int num_containers = static_cast<int>(
+            fs_utils::list_files_matching_regex(output_dir, "packed_texture_\\d+\\.png").size());
+        format_to_packed_texture_array[TextureFormat::rgba8] = {TextureFormat::rgba8, container_side_length,
+                                                                num_containers};
+    }
+
+    // the formats may come after the textures in the file, so the uvs can only be worked out now
+    auto set_texture_coordinates = [&](PackedTextureSubTexture &entry) {
+        int atlas_side_length = format_to_packed_texture_array.at(entry.format).container_side_length;
+        entry.texture_coordinates = compute_texture_coordinates(entry.top_left_x, entry.top_left_y, entry.width,
+                                                                entry.height, atlas_side_length, atlas_side_length);
+    };
 
-    int texture_index = 0;
-    for (const auto &[path, texture_info] : j["sub_textures"].items()) {
-        file_path_to_packed_texture_info[path] =
-            parse_sub_texture(texture_info, atlas_width, atlas_height, texture_index);
-        texture_index++;
+    // textures take the first bounding box indices in path order, so adding a sprite sheet entry doesn't move any
+    // texture, then every sub-atlas entry gets the next one in the order for_each_sub_atlas_entry visits them
+    int bounding_box_index = 0;
+    for (auto &[path, sub_texture] : file_path_to_packed_texture_info) {
+        sub_texture.packed_texture_bounding_box_index = bounding_box_index++;
+        set_texture_coordinates(sub_texture);
     }
+    std::vector<std::string> sub_texture_names;
+    for (auto &[path, sub_texture] : file_path_to_packed_texture_info) {
+        for_each_sub_atlas_entry(sub_texture, sub_texture_names,
+                                 [&](const std::vector<std::string> &, PackedTextureSubTexture &entry) {
+                                     entry.packed_texture_bounding_box_index = bounding_box_index++;
+                                     set_texture_coordinates(entry);
+                                 });
+    }
+    return file_path_to_packed_texture_info;
 }
 
-void TexturePacker::populate_texture_index_to_bounding_box() {
-    // find the maximum index from the packed textures
-    int max_index = 0;
+AtlasReport TexturePacker::build_atlas_report(
+    const std::map<std::string, PackedTextureSubTexture> &file_path_to_packed_texture_info,
+    const std::map<TextureFormat, PackedTextureArray> &format_to_packed_texture_array) const {
+    std::map<std::pair<TextureFormat, int>, std::vector<PixelRect>> container_to_used_rects;
     for (const auto &[file_path, sub_texture] : file_path_to_packed_texture_info) {
-        max_index = std::max(max_index, sub_texture.packed_texture_bounding_box_index);
+        container_to_used_rects[{sub_texture.format, sub_texture.packed_texture_index}].push_back(
+            {sub_texture.top_left_x, sub_texture.top_left_y, sub_texture.width, sub_texture.height});
     }
 
-    // resize the vector to accommodate the maximum index
-    texture_index_to_bounding_box.resize(max_index + 1);
-    global_logger.info("There are {} packed textures", file_path_to_packed_texture_info.size());
+    AtlasReport report;
+    std::vector<const std::vector<PixelRect> *> used_rects_of_container;
+    static const std::vector<PixelRect> no_used_rects;
+    for (const auto &[format, packed_texture_array] : format_to_packed_texture_array) {
+        int side_length = packed_texture_array.container_side_length;
+        // every layer takes the full side length on the gpu, even the trimmed last one
+        size_t layer_bytes = static_cast<size_t>(side_length) * side_length * num_channels(format);
+        report.texture_array_bytes += layer_bytes * num_gpu_layers(packed_texture_array);
+        if (num_gpu_layers(packed_texture_array) < packed_texture_array.num_containers) {
+            report.indirection_table_bytes += sizeof(GLint) * packed_texture_array.num_containers;
+        }
+
+        for (int i = 0; i < packed_texture_array.num_containers; ++i) {
+            ContainerReport container;
+            container.format = to_string(format);
+            container.container_index = i;
+            container.side_length = side_length;
+            container.bytes = layer_bytes;
+            report.containers.push_back(container);
 
+            auto it = container_to_used_rects.find({format, i});
+            used_rects_of_container.push_back(it != container_to_used_rects.end() ? &it->second : &no_used_rects);
+        }
+    }
+
+    // the free space search is the only slow part, so the containers are measured in parallel
+    parallel_for_each_index(report.containers.size(), [&](size_t i) {
+        ContainerReport &container = report.containers[i];
+        const std::vector<PixelRect> &used_rects = *used_rects_of_container[i];
+        long long container_area = static_cast<long long>(container.side_length) * container.side_length;
+
+        container.num_textures = static_cast<int>(used_rects.size());
+        for (const auto &rect : used_rects) {
+            container.used_area += rect.area();
+        }
+        container.free_area = container_area - container.used_area;
+        container.largest_free_rect = find_largest_free_rect(container.side_length, used_rects);
+        container.occupancy = static_cast<double>(container.used_area) / static_cast<double>(container_area);
+        container.fragmentation =
+            container.free_area > 0
+                ? 1.0 - static_cast<double>(container.largest_free_rect.area()) / container.free_area
+                : 0.0;
+    });
+
+    for (const auto &container : report.containers) {
+        report.used_area += container.used_area;
+        report.free_area += container.free_area;
+    }
+    size_t num_entries = file_path_to_packed_texture_info.size();
+    std::vector<std::string> sub_texture_names;
     for (const auto &[file_path, sub_texture] : file_path_to_packed_texture_info) {
-        int packed_texture_bounding_box_index = sub_texture.packed_texture_bounding_box_index;
+        for_each_sub_atlas_entry(sub_texture, sub_texture_names,
+                                 [&](const std::vector<std::string> &, const PackedTextureSubTexture &) {
+                                     num_entries++;
+                                 });
+    }
+    report.bounding_box_texture_bytes = bounding_box_buffer_size(num_entries) * sizeof(glm::vec4);
+    report.total_gpu_bytes =
+        report.texture_array_bytes + report.bounding_box_texture_bytes + report.indirection_table_bytes;
+    return report;
+}
+
+const AtlasReport &TexturePacker::get_atlas_report() const { return atlas_report; }
+
+int TexturePacker::num_gpu_layers(const PackedTextureArray &packed_texture_array) const {
+    if (settings.max_resident_layers > 0) {
+        return std::min(packed_texture_array.num_containers, settings.max_resident_layers);
+    }
+    return packed_texture_array.num_containers;
+}
+
+void TexturePacker::request_texture(const std::string &file_path, int priority) {
+    const PackedTextureSubTexture &sub_texture = get_packed_texture_lookup()->get_packed_texture_sub_texture(file_path);
+    request_container(sub_texture.format, sub_texture.packed_texture_index, priority);
+}
+
+void TexturePacker::request_container(TextureFormat format, int container_index, int priority) {
+    auto it = format_to_layer_residency.find(format);
+    if (it != format_to_layer_residency.end()) {
+        it->second->request(container_index, priority);
+    }
+}
+
+void TexturePacker::update_resident_layers() {
+    for (auto &[format, layer_residency] : format_to_layer_residency) {
+        layer_residency->update();
+    }
+}
+
+int TexturePacker::get_layer_of_container(TextureFormat format, int container_index) const {
+    auto it = format_to_layer_residency.find(format);
+    if (it != format_to_layer_residency.end()) {
+        return it->second->get_slot_of_container(container_index);
+    }
+    return container_index;
+}
+
+LayerResidencyStats TexturePacker::get_layer_residency_stats(TextureFormat format) const {
+    auto it = format_to_layer_residency.find(format);
+    if (it != format_to_layer_residency.end()) {
+        return it->second->get_stats();
+    }
+    return {};
+}
+
+std::vector<glm::vec4> TexturePacker::populate_texture_index_to_bounding_box(
+    const std::map<std::string, PackedTextureSubTexture> &file_path_to_packed_texture_info,
+    const std::map<TextureFormat, PackedTextureArray> &format_to_packed_texture_array) {
+    std::vector<glm::vec4> texture_index_to_bounding_box;
+    global_logger.info("There are {} packed textures", file_path_to_packed_texture_info.size());
+
+    auto add_bounding_box = [&](const PackedTextureSubTexture &entry) {
+        int packed_texture_bounding_box_index = entry.packed_texture_bounding_box_index;
+        if (static_cast<size_t>(packed_texture_bounding_box_index) >= texture_index_to_bounding_box.size()) {
+            texture_index_to_bounding_box.resize(packed_texture_bounding_box_index + 1);
+        }
 
         // construct bounding box (tlx, tly, width, height) and convert everything into 0..1 space.
-        glm::vec4 bounding_box(static_cast<float>(sub_texture.top_left_x) / container_side_length,
-                               static_cast<float>(sub_texture.top_left_y) / container_side_length,
-                               static_cast<float>(sub_texture.width) / container_side_length,
-                               static_cast<float>(sub_texture.height) / container_side_length);
+        float atlas_side_length = format_to_packed_texture_array.at(entry.format).container_side_length;
+        glm::vec4 bounding_box(static_cast<float>(entry.top_left_x) / atlas_side_length,
+                               static_cast<float>(entry.top_left_y) / atlas_side_length,
+                               static_cast<float>(entry.width) / atlas_side_length,
+                               static_cast<float>(entry.height) / atlas_side_length);
 
         global_logger.debug("Accessing bounding box at index {}", packed_texture_bounding_box_index);
         texture_index_to_bounding_box[packed_texture_bounding_box_index] = bounding_box;
+    };
+
+    // sprites inside a sheet get a bounding box of their own, so they can be tiled in the shader too
+    std::vector<std::string> sub_texture_names;
+    for (const auto &[file_path, sub_texture] : file_path_to_packed_texture_info) {
+        add_bounding_box(sub_texture);
+        for_each_sub_atlas_entry(sub_texture, sub_texture_names,
+                                 [&](const std::vector<std::string> &, const PackedTextureSubTexture &entry) {
+                                     add_bounding_box(entry);
+                                 });
     }
+    return texture_index_to_bounding_box;
 }
 
-int TexturePacker::get_packed_texture_index_of_texture(const std::string &file_path) {
-    PackedTextureSubTexture packed_texture = get_packed_texture_sub_texture(file_path);
-    return packed_texture.packed_texture_index;
+PackedTextureLookup::PackedTextureLookup(
+    std::map<std::string, PackedTextureSubTexture> file_path_to_packed_texture_info,
+    std::vector<glm::vec4> texture_index_to_bounding_box)
+    : file_path_to_packed_texture_info(std::move(file_path_to_packed_texture_info)),
+      texture_index_to_bounding_box(std::move(texture_index_to_bounding_box)) {
+    // the map is never modified after this, so pointers to its entries stay valid for the life of the snapshot
+    bounding_box_index_to_entry.resize(this->texture_index_to_bounding_box.size(), nullptr);
+    auto add_entry = [&](const PackedTextureSubTexture &entry) {
+        int index = entry.packed_texture_bounding_box_index;
+        if (index >= 0 && static_cast<size_t>(index) < bounding_box_index_to_entry.size()) {
+            bounding_box_index_to_entry[index] = &entry;
+        }
+    };
+
+    std::vector<std::string> sub_texture_names;
+    for (const auto &[file_path, sub_texture] : this->file_path_to_packed_texture_info) {
+        add_entry(sub_texture);
+        for_each_sub_atlas_entry(sub_texture, sub_texture_names,
+                                 [&](const std::vector<std::string> &, const PackedTextureSubTexture &entry) {
+                                     add_entry(entry);
+                                 });
+    }
+}
+
+const PackedTextureSubTexture &PackedTextureLookup::get_entry_of_bounding_box_index(int bounding_box_index) const {
+    if (bounding_box_index < 0 || static_cast<size_t>(bounding_box_index) >= bounding_box_index_to_entry.size() ||
+        bounding_box_index_to_entry[bounding_box_index] == nullptr) {
+        throw std::out_of_range("No packed texture has bounding box index " + std::to_string(bounding_box_index));
+    }
+    return *bounding_box_index_to_entry[bounding_box_index];
+}
+
+int PackedTextureLookup::get_packed_texture_index_of_texture(const std::string &file_path) const {
+    return get_packed_texture_sub_texture(file_path).packed_texture_index;
 }
 
 /**
  * @brief Finds the texture index of a given texture path from a map of packed texture information.
  *
- * @param file_path_to_packed_texture_info A map linking texture paths to their corresponding PackedTextureSubTexture.
  * @param texture_path The path of the texture to look for.
  * @return The texture index of the corresponding PackedTextureSubTexture.
  * @throws std::runtime_error If the texture path is not found in the map.
  */
-int TexturePacker::get_packed_texture_bounding_box_index_of_texture(const std::string &texture_path) {
+int PackedTextureLookup::get_packed_texture_bounding_box_index_of_texture(const std::string &texture_path) const {
     auto it = file_path_to_packed_texture_info.find(texture_path);
     if (it != file_path_to_packed_texture_info.end()) {
         return it->second.packed_texture_bounding_box_index;
@@ -555,9 +1759,10 @@ int TexturePacker::get_packed_texture_bounding_box_index_of_texture(const std::s
 }
 
 std::vector<glm::vec2>
-TexturePacker::get_packed_texture_coordinates(const std::string &file_path,
-                                              const std::vector<glm::vec2> &texture_coordinates) {
+PackedTextureLookup::get_packed_texture_coordinates(const std::string &file_path,
+                                                    const std::vector<glm::vec2> &texture_coordinates) const {
     std::vector<glm::vec2> packed_coordinates;
+    packed_coordinates.reserve(texture_coordinates.size());
 
     for (const auto &uv : texture_coordinates) {
         glm::vec2 packed_coord = get_packed_texture_coordinate(file_path, uv);
@@ -567,9 +1772,9 @@ TexturePacker::get_packed_texture_coordinates(const std::string &file_path,
     return packed_coordinates;
 }
 
-glm::vec2 TexturePacker::get_packed_texture_coordinate(const std::string &file_path,
-                                                       const glm::vec2 &texture_coordinate) {
-    PackedTextureSubTexture packed_texture = get_packed_texture_sub_texture(file_path);
+glm::vec2 PackedTextureLookup::get_packed_texture_coordinate(const std::string &file_path,
+                                                             const glm::vec2 &texture_coordinate) const {
+    const PackedTextureSubTexture &packed_texture = get_packed_texture_sub_texture(file_path);
 
     if (packed_texture.texture_coordinates.size() < 2) {
         throw std::runtime_error("Packed texture must have at least two opposing corners defined.");
@@ -594,35 +1799,159 @@ glm::vec2 TexturePacker::get_packed_texture_coordinate(const std::string &file_p
     return transformed_coord;
 }
 
-PackedTextureSubTexture TexturePacker::get_packed_texture_sub_texture(const std::string &file_path) {
-    if (file_path_to_packed_texture_info.contains(file_path)) {
-        return file_path_to_packed_texture_info.at(file_path);
+const PackedTextureSubTexture &PackedTextureLookup::get_packed_texture_sub_texture(const std::string &file_path) const {
+    auto it = file_path_to_packed_texture_info.find(file_path);
+    if (it != file_path_to_packed_texture_info.end()) {
+        return it->second;
     }
     throw std::runtime_error("File path not found: " + file_path);
 }
 
-PackedTextureSubTexture TexturePacker::get_packed_texture_sub_texture_atlas(const std::string &file_path,
-                                                                            const std::string &sub_texture_name) {
-    if (file_path_to_packed_texture_info.contains(file_path)) {
-        auto &texture = file_path_to_packed_texture_info.at(file_path);
-        if (texture.sub_atlas.contains(sub_texture_name)) {
-            return texture.sub_atlas.at(sub_texture_name);
+const PackedTextureSubTexture &
+PackedTextureLookup::get_packed_texture_sub_texture_atlas(const std::string &file_path,
+                                                          const std::string &sub_texture_name) const {
+    auto it = file_path_to_packed_texture_info.find(file_path);
+    if (it != file_path_to_packed_texture_info.end()) {
+        auto sub_it = it->second.sub_atlas.find(sub_texture_name);
+        if (sub_it != it->second.sub_atlas.end()) {
+            return sub_it->second;
         }
         throw std::runtime_error("Subtexture name not found: " + sub_texture_name);
     }
     throw std::runtime_error("File path not found in packed texture: " + file_path);
 }
 
-size_t TexturePacker::get_atlas_size_of_sub_texture(const std::string &file_path) {
+const PackedTextureSubTexture &
+PackedTextureLookup::get_nested_sub_texture_atlas(const std::string &file_path,
+                                                  const std::vector<std::string> &sub_texture_names) const {
+    const PackedTextureSubTexture *entry = &get_packed_texture_sub_texture(file_path);
+    for (const auto &sub_texture_name : sub_texture_names) {
+        auto sub_it = entry->sub_atlas.find(sub_texture_name);
+        if (sub_it == entry->sub_atlas.end()) {
+            throw std::runtime_error("Subtexture name not found: " + sub_texture_name);
+        }
+        entry = &sub_it->second;
+    }
+    return *entry;
+}
 
-    if (file_path_to_packed_texture_info.contains(file_path)) {
+size_t PackedTextureLookup::get_atlas_size_of_sub_texture(const std::string &file_path) const {
+    auto it = file_path_to_packed_texture_info.find(file_path);
+    if (it != file_path_to_packed_texture_info.end()) {
+        return it->second.sub_atlas.size();
+    }
+    throw std::runtime_error("File path not found in packed texture: " + file_path);
+}
 
-        auto &texture = file_path_to_packed_texture_info.at(file_path);
+const std::map<std::string, PackedTextureSubTexture> &
+PackedTextureLookup::get_file_path_to_packed_texture_info() const {
+    return file_path_to_packed_texture_info;
+}
+
+const std::vector<glm::vec4> &PackedTextureLookup::get_texture_index_to_bounding_box() const {
+    return texture_index_to_bounding_box;
+}
 
-        return texture.sub_atlas.size();
+/**
+ * @brief Counts the calling thread as reading a lookup snapshot for as long as it lives, see
+ * publish_packed_texture_lookup.
+ */
+class CountedLookupReader {
+  public:
+    explicit CountedLookupReader(std::atomic<int> &reader_count) : reader_count(reader_count) {
+        reader_count.fetch_add(1);
     }
+    ~CountedLookupReader() { reader_count.fetch_sub(1); }
+    CountedLookupReader(const CountedLookupReader &) = delete;
+    CountedLookupReader &operator=(const CountedLookupReader &) = delete;
+
+  private:
+    std::atomic<int> &reader_count;
+};
+
+std::atomic<int> &TexturePacker::lookup_reader_count_of_this_thread() const {
+    static std::atomic<size_t> num_reader_threads = 0;
+    thread_local size_t shard = num_reader_threads.fetch_add(1) % num_lookup_reader_shards;
+    return num_threads_reading_lookup[shard].count;
+}
 
-    throw std::runtime_error("File path not found in packed texture: " + file_path);
+std::shared_ptr<const PackedTextureLookup> TexturePacker::get_packed_texture_lookup() const {
+    // announcing ourselves before loading the pointer guarantees the snapshot isn't freed until we own a reference
+    CountedLookupReader reader(lookup_reader_count_of_this_thread());
+    return current_packed_texture_lookup.load()->shared_from_this();
 }
 
-void TexturePacker::bind_texture_array() { glBindTexture(GL_TEXTURE_2D_ARRAY, packed_texture_array_gl_id); }
+void TexturePacker::publish_packed_texture_lookup(std::shared_ptr<const PackedTextureLookup> packed_texture_lookup) {
+    current_packed_texture_lookup.store(packed_texture_lookup.get());
+    published_packed_texture_lookups.push_back(std::move(packed_texture_lookup));
+
+    // a reader that loaded an older pointer is still counted here until it owns a reference or is done with its
+    // lookup, so when nobody is reading, a retired snapshot that only we own can't be picked up again and is safe to
+    // free. A reader counted in a shard after we read it loads the pointer stored above, so the shards can be read one
+    // at a time
+    bool no_threads_reading_lookup =
+        std::all_of(num_threads_reading_lookup.begin(), num_threads_reading_lookup.end(),
+                    [](const LookupReaderCount &shard) { return shard.count.load() == 0; });
+    if (no_threads_reading_lookup) {
+        std::erase_if(published_packed_texture_lookups, [&](const auto &lookup) {
+            return lookup.get() != current_packed_texture_lookup.load() && lookup.use_count() == 1;
+        });
+    }
+}
+
+int TexturePacker::get_packed_texture_index_of_texture(const std::string &file_path) {
+    CountedLookupReader reader(lookup_reader_count_of_this_thread());
+    return current_packed_texture_lookup.load()->get_packed_texture_index_of_texture(file_path);
+}
+
+int TexturePacker::get_packed_texture_bounding_box_index_of_texture(const std::string &texture_path) {
+    CountedLookupReader reader(lookup_reader_count_of_this_thread());
+    return current_packed_texture_lookup.load()->get_packed_texture_bounding_box_index_of_texture(texture_path);
+}
+
+std::vector<glm::vec2>
+TexturePacker::get_packed_texture_coordinates(const std::string &file_path,
+                                              const std::vector<glm::vec2> &texture_coordinates) {
+    CountedLookupReader reader(lookup_reader_count_of_this_thread());
+    return current_packed_texture_lookup.load()->get_packed_texture_coordinates(file_path, texture_coordinates);
+}
+
+glm::vec2 TexturePacker::get_packed_texture_coordinate(const std::string &file_path,
+                                                       const glm::vec2 &texture_coordinate) {
+    CountedLookupReader reader(lookup_reader_count_of_this_thread());
+    return current_packed_texture_lookup.load()->get_packed_texture_coordinate(file_path, texture_coordinate);
+}
+
+PackedTextureSubTexture TexturePacker::get_packed_texture_sub_texture(const std::string &file_path) {
+    CountedLookupReader reader(lookup_reader_count_of_this_thread());
+    return current_packed_texture_lookup.load()->get_packed_texture_sub_texture(file_path);
+}
+
+PackedTextureSubTexture TexturePacker::get_packed_texture_sub_texture_atlas(const std::string &file_path,
+                                                                            const std::string &sub_texture_name) {
+    CountedLookupReader reader(lookup_reader_count_of_this_thread());
+    return current_packed_texture_lookup.load()->get_packed_texture_sub_texture_atlas(file_path, sub_texture_name);
+}
+
+PackedTextureSubTexture TexturePacker::get_nested_sub_texture_atlas(const std::string &file_path,
+                                                                    const std::vector<std::string> &sub_texture_names) {
+    CountedLookupReader reader(lookup_reader_count_of_this_thread());
+    return current_packed_texture_lookup.load()->get_nested_sub_texture_atlas(file_path, sub_texture_names);
+}
+
+size_t TexturePacker::get_atlas_size_of_sub_texture(const std::string &file_path) {
+    CountedLookupReader reader(lookup_reader_count_of_this_thread());
+    return current_packed_texture_lookup.load()->get_atlas_size_of_sub_texture(file_path);
+}
+
+void TexturePacker::bind_texture_array() { bind_texture_array(TextureFormat::rgba8); }
+
+void TexturePacker::bind_texture_array(TextureFormat format) {
+    auto it = format_to_packed_texture_array.find(format);
+    if (it == format_to_packed_texture_array.end()) {
+        return;
+    }
+    glActiveTexture(texture_unit_of_format(format));
+    glBindTexture(GL_TEXTURE_2D_ARRAY, it->second.gl_id);
+    glActiveTexture(GL_TEXTURE0);
+}
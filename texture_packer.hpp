@@ -1,10 +1,17 @@
 #ifndef TEXTURE_PACKER_HPP
 #define TEXTURE_PACKER_HPP
 
+#include <array>
+#include <atomic>
+#include <functional>
+#include <future>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <nlohmann/json_fwd.hpp>
 #include <optional>
 #include <set>
+#include <span>
 #include <unordered_set>
 #include <vector>
 #include <string>
@@ -17,35 +24,176 @@
 
 #include "sbpt_generated_includes.hpp"
 #include "split_packer.hpp"
+#include "packing_search.hpp"
+#include "image_loading_pipeline.hpp"
+#include "bake_cache.hpp"
+#include "atlas_report.hpp"
+#include "layer_residency.hpp"
+#include "packed_texture_metadata.hpp"
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
+/**
+ * @brief The pixel format textures are stored in on the gpu, every format is packed into its own texture array.
+ */
+enum class TextureFormat { r8, rg8, rgba8 };
+
+int num_channels(TextureFormat format);
+std::string to_string(TextureFormat format);
+TextureFormat texture_format_from_string(const std::string &format);
+/// one channel textures are r8, two channel ones are rg8 and everything else is rgba8
+TextureFormat texture_format_from_num_channels(int num_channels);
+/// rgba8 keeps the original packed_texture_N.png name, other formats are packed_texture_<format>_N.png
+std::string packed_texture_filename(TextureFormat format, int container_index);
+/// rgba8 is bound to GL_TEXTURE0 like before, GL_TEXTURE1 holds the bounding boxes, then r8 and rg8 follow
+GLenum texture_unit_of_format(TextureFormat format);
+/// the container to layer indirection tables of rgba8, r8 and rg8 go on GL_TEXTURE4, GL_TEXTURE5 and GL_TEXTURE6
+GLenum indirection_table_unit_of_format(TextureFormat format);
+
 /// new VVV
 
-struct TextureBlock {
-    TextureBlock(int width, int height, const std::string &file) : block(width, height), texture_path(file) {};
-    Block block;
-    std::string texture_path;
-    std::map<std::string, std::map<std::string, float>> subtextures;
+/**
+ * @brief Every texture being packed, stored as parallel arrays indexed by the id of the texture.
+ *
+ * Packing only reads `sizes` and writes `placements`, the paths and sub-texture records are kept out of line and are
+ * only read when the metadata is written, so the search never copies strings or maps around.
+ */
+struct TextureBlockTable {
+    /// the size each texture is packed at, which is smaller than its source image when it was downscaled
+    BlockSizes sizes;
+    BlockSizes source_sizes;
+    /// the factor each texture was downscaled by, 1 when it wasn't
+    std::vector<float> scales;
+    /// lower priority textures are downscaled first, see TexturePackerSettings::directory_priorities
+    std::vector<int> priorities;
+    /// the number of channels stored in each source image
+    std::vector<int> num_channels;
+    /// where each texture ended up, within the containers of its format
+    std::vector<std::optional<BlockPlacement>> placements;
+    std::vector<std::string> texture_paths;
+    /// the sub-textures of texture i are sub_texture_records[sub_texture_offsets[i]] up to sub_texture_offsets[i + 1]
+    std::vector<SubTextureRecord> sub_texture_records;
+    std::vector<size_t> sub_texture_offsets = {0};
+
+    size_t size() const { return texture_paths.size(); }
+    /// adds a texture and returns its id, its sub-textures have to be added right after it
+    size_t add_texture(std::string texture_path, int width, int height, int num_channels, int priority = 0);
+    /// packs the texture at `scale` times the size of its source image, but never smaller than one pixel
+    void set_scale(size_t texture_id, float scale);
+    void add_sub_texture(SubTextureRecord record);
+    std::span<const SubTextureRecord> get_sub_textures(size_t texture_id) const;
+    /// the sizes of the given textures, in the order of `texture_ids`
+    BlockSizes sizes_of(const std::vector<size_t> &texture_ids) const;
 };
 
 struct PackedTextureContainer {
     std::shared_ptr<SplitPacker> packer;
-    std::vector<TextureBlock> packed_texture_blocks;
+    /// the ids of the textures in this container, in the order they were placed
+    std::vector<size_t> texture_ids;
 };
 
 /// new ^^^
 
+/**
+ * @brief Controls how the side length of the texture containers is chosen.
+ */
+enum class ContainerSizing {
+    /// every container uses exactly the requested side length
+    fixed,
+    /// the smallest power of two side length (up to the requested one) that fits in the fewest containers
+    auto_power_of_two,
+    /// the smallest multiple of four side length (up to the requested one) that fits in the fewest containers
+    auto_multiple_of_four,
+};
+
+/**
+ * @brief What regenerate does when a bake needs more gpu memory than the budget allows.
+ */
+enum class BudgetAction {
+    /// log a warning and carry on
+    warn,
+    /// throw a std::runtime_error before anything is uploaded
+    fail,
+};
+
+/**
+ * @brief Optional knobs for the texture packer, the defaults reproduce the original behavior.
+ */
+struct TexturePackerSettings {
+    ContainerSizing container_sizing = ContainerSizing::fixed;
+    /// the smallest side length the automatic sizing search will consider
+    int min_container_side_length = 16;
+    /// with automatic container sizing, crop the image of the last container to the area its textures actually use,
+    /// fixed sizing always writes full containers
+    bool trim_last_container = true;
+    /// how many block orderings and split rules to try, one does a single greedy pass and num_packing_strategies
+    /// tries all of them, see search_for_best_packing
+    int packing_search_candidates = 1;
+    /// pack one and two channel textures into their own r8 and rg8 texture arrays instead of expanding them to rgba8
+    bool group_by_channel_count = false;
+    /// when set, a header of constexpr texture ids is written here after every regenerate, see write_texture_id_header
+    std::filesystem::path texture_id_header_path;
+    /// thread counts and queue depths used when reading and decoding images
+    ImageLoadingPipelineSettings image_loading;
+    /// when set, finished bakes are shared through this directory (local or a network mount), see compute_bake_key
+    std::filesystem::path bake_cache_directory;
+    /// the bake cache evicts its least recently used bundles once it grows past this
+    std::uintmax_t bake_cache_max_size_bytes = std::uintmax_t(4) << 30;
+    /// when set, the atlas report is written here as json after every regenerate, see get_atlas_report
+    std::filesystem::path atlas_report_path;
+    /// the most gpu memory a bake may take, see AtlasReport::total_gpu_bytes, zero means there is no budget
+    size_t gpu_memory_budget_bytes = 0;
+    BudgetAction gpu_memory_budget_action = BudgetAction::warn;
+    /// when a format has more containers than this, only this many layers live on the gpu and containers are paged
+    /// in on request, see request_texture, zero keeps every container resident
+    int max_resident_layers = 0;
+    /// keep decoded cpu copies of paged containers instead of their png bytes, which pages in faster but takes more
+    /// memory
+    bool keep_decoded_layer_copies = false;
+    /// the most layers one update_resident_layers call uploads per format, zero is no limit
+    int max_layer_uploads_per_frame = 0;
+    /// downscale textures that are bigger than the container so that they fit, instead of leaving them out
+    bool downscale_oversized_textures = false;
+    /// downscale textures, lowest priority first, until the bake is estimated to fit in `gpu_memory_budget_bytes`
+    bool downscale_to_fit_gpu_memory_budget = false;
+    /// textures are never downscaled to less than this fraction of their size to fit the budget
+    float min_downscale = 0.125f;
+    /// the priority of the textures under each directory, the most specific directory wins and a "priority" in the
+    /// sidecar json of a texture overrides it, textures outside of every listed directory have priority zero
+    std::map<std::filesystem::path, int> directory_priorities;
+    /// when set, the constructor returns right away and scanning, packing and writing the bake run as a job handed to
+    /// this, for example `[](std::function<void()> job) { std::thread(std::move(job)).detach(); }`, the result is
+    /// uploaded by TexturePacker::process_pending_gl_work
+    std::function<void(std::function<void()>)> executor;
+};
+
+/**
+ * @brief A gpu texture array holding every container of one format.
+ */
+struct PackedTextureArray {
+    TextureFormat format;
+    int container_side_length;
+    int num_containers;
+    GLuint gl_id = 0;
+};
+
 // TODO was working on consructing a function which gives back you texture index
 // rename texture index to packed texture index bounding shit
 // and then in main use that and store that data into IVPTP shit and then
 // when drawing upload that extra data and things should work? try it out on gypsum factor.
 
 struct PackedTextureSubTexture {
+    /// the texel of the bounding box texture holding this entry's bounding box, textures come first in path order and
+    /// are followed by every sub-atlas entry
     int packed_texture_bounding_box_index;
+    /// the index of the container within the texture array of `format`
     int packed_texture_index;
+    TextureFormat format = TextureFormat::rgba8;
+    /// how much the texture was downscaled by to fit, the rects are in packed pixels so a source pixel is `scale` wide
+    float scale = 1.0f;
     std::vector<glm::vec2> texture_coordinates;
+    /// the named rects inside this one, which can have sub-atlases of their own
     std::map<std::string, PackedTextureSubTexture> sub_atlas;
     int top_left_x;
     int top_left_y;
@@ -55,7 +203,9 @@ struct PackedTextureSubTexture {
     friend std::ostream &operator<<(std::ostream &os, const PackedTextureSubTexture &pts) {
         os << "PackedTextureSubTexture {"
            << "\n  Bounding Box Index: " << pts.packed_texture_bounding_box_index
-           << "\n  Texture Index: " << pts.packed_texture_index << "\n  Top Left: (" << pts.top_left_x << ", "
+           << "\n  Texture Index: " << pts.packed_texture_index << "\n  Format: " << to_string(pts.format)
+           << "\n  Scale: " << pts.scale
+           << "\n  Top Left: (" << pts.top_left_x << ", "
            << pts.top_left_y << ")"
            << "\n  Size: " << pts.width << "x" << pts.height << "\n  Texture Coordinates: [";
 
@@ -75,6 +225,64 @@ struct PackedTextureSubTexture {
     }
 };
 
+/**
+ * @class PackedTextureLookup
+ * @brief An immutable snapshot of where every packed texture lives.
+ *
+ * `TexturePacker` publishes a new snapshot every time it regenerates and never modifies one after publishing it, so
+ * any number of threads can read from a snapshot without locking. Worker threads should take one with
+ * `TexturePacker::get_packed_texture_lookup()` at the start of a job and do all of their lookups through it, it stays
+ * valid for as long as it is held even if the packer regenerates in the meantime.
+ *
+ * The lookup functions behave the same as the ones with the same name on `TexturePacker`.
+ */
+class PackedTextureLookup : public std::enable_shared_from_this<PackedTextureLookup> {
+  public:
+    PackedTextureLookup() = default;
+    PackedTextureLookup(std::map<std::string, PackedTextureSubTexture> file_path_to_packed_texture_info,
+                        std::vector<glm::vec4> texture_index_to_bounding_box);
+
+    // the bounding box table points into the map, a copy's table would point into the original. Moving keeps the
+    // nodes of the map where they are, so it is fine
+    PackedTextureLookup(const PackedTextureLookup &) = delete;
+    PackedTextureLookup &operator=(const PackedTextureLookup &) = delete;
+    PackedTextureLookup(PackedTextureLookup &&) = default;
+    PackedTextureLookup &operator=(PackedTextureLookup &&) = default;
+
+    const PackedTextureSubTexture &get_packed_texture_sub_texture(const std::string &file_path) const;
+    int get_packed_texture_index_of_texture(const std::string &file_path) const;
+    int get_packed_texture_bounding_box_index_of_texture(const std::string &texture_path) const;
+    glm::vec2 get_packed_texture_coordinate(const std::string &file_path, const glm::vec2 &texture_coordinate) const;
+    std::vector<glm::vec2> get_packed_texture_coordinates(const std::string &file_path,
+                                                          const std::vector<glm::vec2> &texture_coordinates) const;
+    const PackedTextureSubTexture &get_packed_texture_sub_texture_atlas(const std::string &file_path,
+                                                                        const std::string &sub_texture_name) const;
+    const PackedTextureSubTexture &
+    get_nested_sub_texture_atlas(const std::string &file_path, const std::vector<std::string> &sub_texture_names) const;
+    size_t get_atlas_size_of_sub_texture(const std::string &file_path) const;
+
+    /**
+     * @brief Gets the texture or sub-atlas entry whose bounding box is at the given index.
+     *
+     * @throws std::out_of_range If no entry has that index.
+     */
+    const PackedTextureSubTexture &get_entry_of_bounding_box_index(int bounding_box_index) const;
+
+    /** @brief Map from file path to its packed texture metadata. */
+    const std::map<std::string, PackedTextureSubTexture> &get_file_path_to_packed_texture_info() const;
+
+    /** @brief Mapping from texture index to bounding box (top left and size in uv space), as uploaded to the gpu. */
+    const std::vector<glm::vec4> &get_texture_index_to_bounding_box() const;
+
+  private:
+    // a texture index is simply a unique identifier given to each texture path
+    // note that it has nothing ot do with a packed index or anything like that
+    std::map<std::string, PackedTextureSubTexture> file_path_to_packed_texture_info;
+    std::vector<glm::vec4> texture_index_to_bounding_box;
+    /// points into `file_path_to_packed_texture_info`, nested entries included
+    std::vector<const PackedTextureSubTexture *> bounding_box_index_to_entry;
+};
+
 /**
  * @class TexturePacker
  * @brief Handles automatic texture atlas generation and management for efficient GPU texture storage.
@@ -87,11 +295,17 @@ struct PackedTextureSubTexture {
  * This is useful in rendering engines or voxel systems that need to batch draw calls by
  * minimizing texture switches.
  *
- * @TODO as of right now the texture packer has a huge problem which is that its run everytime the program starts, in
- * order to correct this we need to improve our fs_utils so that we can save the state of a whole directory to file,
- * only saving the metadata such as when a file was last created or modified, and the ability to read this and then see
- * if new files have been created or modified, whenever this is true we run the texture packer, when this is not true,
- * then all the texture are still packed so we don't have to do anything else.
+ * The lookup functions may be called from any thread while `regenerate` runs on another one, they read from the
+ * current `PackedTextureLookup` snapshot. Each call borrows the snapshot for its own duration, which costs two atomic
+ * operations on a per thread counter but no reference count, so it is fine for the odd lookup. Hot loops on worker
+ * threads should still hold on to `get_packed_texture_lookup()`, which makes every lookup after it a plain call and
+ * keeps them all on the same snapshot.
+ *
+ * When `TexturePackerSettings::executor` is set construction doesn't block. The bake left in `output_dir` by the last
+ * run is served first, while the executor scans the textures and compares their bake key against the one stored with
+ * that bake, only packing again when they differ. The new bake is written to a staging directory and swapped in by
+ * `process_pending_gl_work`, which has to be called on the gl thread, for example once a frame, since that is where
+ * the uploads happen. `get_ready_future`, `on_ready` and `await_texture` tell when the textures can be used.
  */
 class TexturePacker {
   public:
@@ -100,10 +314,53 @@ class TexturePacker {
      *
      * @param textures_directory The directory containing source textures to be packed.
      * @param output_dir The directory where packed texture atlases and metadata will be written.
-     * @param container_side_length The side length (in pixels) of each texture container (atlas).
+     * @param container_side_length The side length (in pixels) of each texture container (atlas), when automatic
+     * container sizing is enabled this is the largest side length that may be chosen.
+     * @param settings Optional packing settings.
      */
     TexturePacker(const std::filesystem::path &textures_directory, const std::filesystem::path &output_dir,
-                  int container_side_length);
+                  int container_side_length, const TexturePackerSettings &settings = {});
+
+    /**
+     * @brief Waits for the background bake if the executor has started it, as it refers to this packer.
+     *
+     * A bake the executor hasn't started yet is cancelled instead, if it does run later it returns straight away. So an
+     * executor that drops jobs or is shut down before running them doesn't hang the destructor, though the ready
+     * future of such a packer is never resolved.
+     */
+    ~TexturePacker();
+
+    /**
+     * @brief Uploads and publishes whatever the background bake has finished since the last call.
+     *
+     * Must be called on the thread owning the gl context, does nothing when there is no executor.
+     */
+    void process_pending_gl_work();
+
+    /**
+     * @brief Gets a future which becomes ready once the up to date bake is published.
+     *
+     * It holds the error if the bake failed. Without an executor it is ready as soon as the constructor returns.
+     */
+    std::shared_future<void> get_ready_future() const;
+
+    /**
+     * @brief Calls `callback` once the up to date bake is published, or failed to be, see get_ready_future.
+     *
+     * The callback runs inside process_pending_gl_work, or right away if the packer is already ready. An exception
+     * thrown by a callback run from process_pending_gl_work is logged and doesn't stop the other callbacks.
+     */
+    void on_ready(std::function<void()> callback);
+
+    /**
+     * @brief Gets a future which becomes ready once a published snapshot contains the texture.
+     *
+     * When the previous bake already has the texture this is as soon as it is served, otherwise it is when the new
+     * bake is published. If the packer becomes ready without the texture the future holds a std::runtime_error.
+     *
+     * @param file_path Path to the texture file.
+     */
+    std::shared_future<void> await_texture(const std::string &file_path);
 
     /**
      * @brief Rebuilds the texture atlas, optionally with new texture inputs.
@@ -111,6 +368,8 @@ class TexturePacker {
      * If no texture paths are provided, this regenerates based on all textures
      * found in the `textures_directory`.
      *
+     * When the packer was constructed with an executor, this shouldn't be called before it is ready.
+     *
      * @param new_texture_paths Optional list of new texture file paths to include.
      */
     void regenerate(const std::vector<std::string> &new_texture_paths = {});
@@ -133,7 +392,8 @@ class TexturePacker {
      *
      * @param texture_paths A list of file paths to textures to be packed.
      * @param output_dir Directory where packed atlases will be stored.
-     * @param container_side_length The size (in pixels) of each atlas container.
+     * @param container_side_length The size (in pixels) of each atlas container, or the maximum size when automatic
+     * container sizing is enabled.
      */
     void pack_textures(const std::vector<std::string> &texture_paths, const std::filesystem::path &output_dir,
                        int container_side_length);
@@ -141,13 +401,30 @@ class TexturePacker {
     /**
      * @brief Packs texture blocks into texture containers (atlases).
      *
-     * @param texture_blocks The texture blocks to be packed.
+     * The best of the first `settings.packing_search_candidates` packing strategies is used. When built with
+     * TEXTURE_PACKER_COUNT_ALLOCATIONS the number of heap allocations the packing made is logged.
+     *
+     * @param texture_blocks The table of textures, the placements of the packed ones are set.
+     * @param texture_ids The ids of the textures to pack.
      * @param container_size The side length of each texture container.
      * @return A vector of `PackedTextureContainer` objects representing generated atlases.
      */
-    std::vector<PackedTextureContainer> pack_texture_blocks_into_containers(std::vector<TextureBlock> &texture_blocks,
+    std::vector<PackedTextureContainer> pack_texture_blocks_into_containers(TextureBlockTable &texture_blocks,
+                                                                            const std::vector<size_t> &texture_ids,
                                                                             int container_size);
 
+    /**
+     * @brief Searches for the smallest container side length which packs the blocks into the fewest containers.
+     *
+     * Every candidate side length allowed by `settings.container_sizing` is trial packed in parallel, the fewest
+     * containers wins and ties are broken by the smaller side length.
+     *
+     * @param blocks The sizes of the blocks to be packed.
+     * @param max_container_side_length The largest side length that may be chosen.
+     * @return The chosen side length.
+     */
+    int choose_container_side_length(const BlockSizes &blocks, int max_container_side_length);
+
     /**
      * @brief Retrieves all texture file paths from a directory.
      *
@@ -159,13 +436,32 @@ class TexturePacker {
                                                const std::filesystem::path &output_dir);
 
     /**
-     * @brief Converts file paths into texture block objects.
+     * @brief Reads the size of every texture and the sub-textures from its sidecar json.
      *
      * @param texture_paths A list of texture file paths.
-     * @return A vector of constructed `TextureBlock` objects.
+     * @return A table holding every texture which could be read.
+     */
+    TextureBlockTable construct_texture_blocks_from_texture_paths(const std::vector<std::string> &texture_paths);
+
+    /**
+     * @brief Computes the key the bake of the given textures is stored under in the bake cache.
+     *
+     * The key covers the bake format version, every source path along with the contents of the image and its sidecar
+     * json, the container side length and every setting which changes the packed output. Packing is deterministic, so
+     * every machine that bakes the same key produces the same output.
+     *
+     * @param texture_paths The textures to bake, their order doesn't matter.
+     * @param container_side_length The side length passed to pack_textures.
+     * @return The key as a hex string.
      */
-    std::vector<TextureBlock>
-    construct_texture_blocks_from_texture_paths(const std::vector<std::string> &texture_paths);
+    std::string compute_bake_key(const std::vector<std::string> &texture_paths, int container_side_length) const;
+
+    /**
+     * @brief Gets the current snapshot of the lookup tables, which can be read from any thread without locking.
+     *
+     * @return The snapshot published by the last successful regenerate, it is empty before that.
+     */
+    std::shared_ptr<const PackedTextureLookup> get_packed_texture_lookup() const;
 
     /**
      * @brief Retrieves packed sub-texture information for a given texture file.
@@ -222,6 +518,16 @@ class TexturePacker {
     PackedTextureSubTexture get_packed_texture_sub_texture_atlas(const std::string &file_path,
                                                                  const std::string &sub_texture_name);
 
+    /**
+     * @brief Retrieves a sub-texture nested inside other sub-textures of a packed atlas.
+     *
+     * @param file_path Path to the texture atlas file.
+     * @param sub_texture_names The name of each sub-texture on the way down, outermost first.
+     * @return The corresponding `PackedTextureSubTexture` object.
+     */
+    PackedTextureSubTexture get_nested_sub_texture_atlas(const std::string &file_path,
+                                                         const std::vector<std::string> &sub_texture_names);
+
     /**
      * @brief Gets the number of sub-textures in a given texture atlas.
      *
@@ -230,6 +536,65 @@ class TexturePacker {
      */
     size_t get_atlas_size_of_sub_texture(const std::string &file_path);
 
+    /**
+     * @brief Writes a C++ header with a constexpr id for every packed texture and sub-atlas entry.
+     *
+     * The header is self contained and defines, in the `packed_texture_ids` namespace, a `TextureId` enum with one
+     * enumerator per packed path, a `SubTextureId` enum per sprite sheet inside `sub_textures::<sheet>`, and a
+     * `rects` table indexed by either kind of id holding the container index, format, bounding box index, pixel rect
+     * and uv rect. Entries nested deeper in a sheet are named after every sub-texture on the way down, and every id is
+     * also the entry's bounding box index. Looking a texture up is then
+     * `packed_texture_ids::rects[packed_texture_ids::assets_grass_png]`, and a texture that no longer exists fails the
+     * build instead of throwing at runtime.
+     *
+     * The file is only rewritten when its contents change, so it doesn't cause rebuilds on every run.
+     *
+     * @param header_path Where to write the header.
+     */
+    void write_texture_id_header(const std::filesystem::path &header_path);
+
+    /**
+     * @brief Marks the container holding a texture as needed this frame when layers are paged.
+     *
+     * Does nothing if every container of the texture's format is resident.
+     *
+     * @param file_path Path to the texture file.
+     * @param priority Higher priority containers are paged in first, and the lowest priority ones are left out when a
+     * frame requests more containers than there are layers.
+     */
+    void request_texture(const std::string &file_path, int priority = 0);
+
+    /**
+     * @brief Marks a container as needed this frame when layers are paged.
+     */
+    void request_container(TextureFormat format, int container_index, int priority = 0);
+
+    /**
+     * @brief Pages in the containers requested since the last call, call this once a frame before drawing.
+     */
+    void update_resident_layers();
+
+    /**
+     * @brief Gets the layer of the texture array a container is currently in.
+     *
+     * @return The container index itself when every container is resident, -1 if the container is paged out.
+     */
+    int get_layer_of_container(TextureFormat format, int container_index) const;
+
+    /**
+     * @brief Gets how many layers were paged in and evicted and how many requests couldn't be served for a format.
+     *
+     * @return All zeros when the containers of the format aren't paged.
+     */
+    LayerResidencyStats get_layer_residency_stats(TextureFormat format) const;
+
+    /**
+     * @brief Gets the report of how well the last bake uses its containers and how much gpu memory it takes.
+     *
+     * Like the texture arrays, this is replaced by regenerate and shouldn't be read while it runs.
+     */
+    const AtlasReport &get_atlas_report() const;
+
     /**
      * @brief Binds the packed texture array and bounding box buffers to OpenGL.
      *
@@ -237,6 +602,13 @@ class TexturePacker {
      */
     void bind_texture_array();
 
+    /**
+     * @brief Binds the packed texture array of the given format to its texture unit.
+     *
+     * @param format The format whose array should be bound, see texture_unit_of_format.
+     */
+    void bind_texture_array(TextureFormat format);
+
     /** @brief List of currently held texture file paths. */
     std::vector<std::string> currently_held_texture_paths;
 
@@ -246,50 +618,217 @@ class TexturePacker {
     /** @brief Output directory where packed atlases and metadata are saved. */
     std::filesystem::path output_dir;
 
-    /** @brief Side length (in pixels) of each texture container (atlas). */
+    /** @brief Side length (in pixels) of each texture container (atlas), this is the chosen one when auto sizing. */
     int container_side_length;
 
-    /** @brief Mapping from texture index to bounding box (UV min/max and atlas index). */
-    std::vector<glm::vec4> texture_index_to_bounding_box;
+    /** @brief The side length requested at construction, the upper bound when auto sizing. */
+    int max_container_side_length;
+
+    /** @brief Settings this packer was constructed with. */
+    TexturePackerSettings settings;
+
+    /** @brief The texture array of every format that has at least one packed texture. */
+    std::map<TextureFormat, PackedTextureArray> format_to_packed_texture_array;
 
   private:
     /**
-     * @brief Records mapping between a file path and its packed texture information.
+     * @brief Writes the bake of the given textures to `bake_dir`, through the bake cache when there is one.
+     *
+     * @param bake_key The key of the textures if it is already known, it is computed when the bake cache needs it.
+     * @return The bake key, empty when it wasn't needed.
+     */
+    std::string bake(const std::vector<std::string> &texture_paths, const std::filesystem::path &bake_dir,
+                     std::string bake_key = {});
+
+    /**
+     * @brief Reads the bake in `output_dir`, uploads it and publishes a snapshot of it.
      *
-     * @param file_path The texture file path.
-     * @param atlas_width Width of the packed texture atlas.
-     * @param atlas_height Height of the packed texture atlas.
+     * The texture arrays of the loaded bake are deleted once the new ones are uploaded. Throws, leaving the loaded
+     * bake in place, when the bake holds no textures, has more bounding boxes than a buffer texture can hold or is
+     * over a gpu memory budget set to fail.
+     */
+    void load_bake();
+
+    /**
+     * @brief The job handed to the executor, bakes into the staging directory unless the current bake is up to date.
+     */
+    void bake_in_background();
+
+    /** @brief Queues work for the next process_pending_gl_work call, may be called from any thread. */
+    void enqueue_gl_work(std::function<void()> work);
+
+    /**
+     * @brief Resolves the ready future, the ready callbacks and the remaining texture waiters, only the first call
+     * does anything.
      */
-    void set_file_path_to_packed_texture_map(const std::filesystem::path &file_path, unsigned int atlas_width,
-                                             unsigned int atlas_height);
+    void mark_ready(std::exception_ptr error = nullptr);
+
+    std::mutex pending_gl_work_mutex;
+    std::vector<std::function<void()>> pending_gl_work;
+
+    /** @brief Guards everything below, and is held while publishing so a waiter can't miss the snapshot it waits on. */
+    std::mutex readiness_mutex;
+    bool ready = false;
+    std::promise<void> ready_promise;
+    std::shared_future<void> ready_future = ready_promise.get_future().share();
+    std::vector<std::function<void()>> ready_callbacks;
+    std::map<std::string, std::vector<std::promise<void>>> texture_waiters;
+
+    /** @brief Whether the previous bake was served before the background bake finished, only used on the gl thread. */
+    bool previous_bake_loaded = false;
+
+    /** @brief Set by the background bake as the last thing it does. */
+    std::promise<void> background_bake_finished;
+    std::future<void> background_bake_finished_future;
 
     /**
-     * @brief Populates the GPU buffer mapping texture indices to bounding boxes.
+     * @brief Set by whichever comes first, the background bake starting or the destructor cancelling it.
+     *
+     * Shared with the job, so a job that runs after the packer is gone can still tell it was cancelled.
      */
-    void populate_texture_index_to_bounding_box();
+    std::shared_ptr<std::atomic<bool>> background_bake_claimed;
 
     /**
-     * @brief Parses a sub-texture entry from JSON metadata.
+     * @brief Packs the texture blocks of one format, writes their container images and adds their metadata.
      *
-     * @param sub_texture_json JSON object describing the sub-texture.
-     * @param atlas_width Width of the atlas texture.
-     * @param atlas_height Height of the atlas texture.
-     * @param texture_index The index of the texture within the atlas.
+     * @param texture_blocks The table of textures.
+     * @param texture_ids The ids of the textures that are stored in `format`.
+     * @param format The format of the containers.
+     * @param container_side_length The side length of the containers.
+     * @param output_dir Directory where packed atlases will be stored.
+     * @param image_loading_pool The pool the images of every container are loaded with.
+     * @param result The packed texture metadata json to add to.
+     */
+    void pack_texture_blocks_of_format(TextureBlockTable &texture_blocks, const std::vector<size_t> &texture_ids,
+                                       TextureFormat format, int container_side_length,
+                                       const std::filesystem::path &output_dir, ImageLoadingPool &image_loading_pool,
+                                       nlohmann::json &result);
+
+    /**
+     * @brief Downscales the textures that don't fit in a container so that they do.
+     */
+    void downscale_oversized_textures(TextureBlockTable &texture_blocks, int container_side_length);
+
+    /**
+     * @brief Downscales textures, lowest priority first, until the bake is estimated to fit the gpu memory budget.
+     *
+     * Each round shrinks every texture of the lowest priority which can still shrink by another step, halving its
+     * area, and packs everything again with the default strategy to estimate the gpu memory. Higher priorities are
+     * only touched once every lower one is at `settings.min_downscale`.
+     */
+    void downscale_to_fit_gpu_memory_budget(TextureBlockTable &texture_blocks,
+                                            const std::map<TextureFormat, std::vector<size_t>> &format_to_texture_ids,
+                                            int container_side_length);
+
+    /**
+     * @brief Estimates the gpu memory of a bake by packing every format with the default strategy.
+     */
+    size_t estimate_gpu_bytes(const TextureBlockTable &texture_blocks,
+                              const std::map<TextureFormat, std::vector<size_t>> &format_to_texture_ids,
+                              int container_side_length) const;
+
+    /**
+     * @brief Creates the gl texture array for one format and uploads each of its packed container images into it.
+     *
+     * @param packed_texture_array The array to upload, its `gl_id` is set.
+     * @param image_loading_pool The pool the container images are loaded with.
+     * @return The residency manager paging its layers in, or null when every layer fits on the gpu.
+     */
+    std::unique_ptr<LayerResidencyManager> upload_packed_texture_array(PackedTextureArray &packed_texture_array,
+                                                                       ImageLoadingPool &image_loading_pool);
+
+    /**
+     * @brief Reads the mapping between each file path and its packed texture information.
+     *
+     * Nothing on the packer is changed, so a bake can be read and checked before it replaces the loaded one.
+     *
+     * @param file_path The path to the packed texture metadata json.
+     * @param format_to_packed_texture_array Cleared and filled with the texture array of every format, their `gl_id`
+     * is left at 0.
+     * @return Map from file path to its packed texture metadata.
+     */
+    std::map<std::string, PackedTextureSubTexture>
+    read_file_path_to_packed_texture_map(const std::filesystem::path &file_path,
+                                         std::map<TextureFormat, PackedTextureArray> &format_to_packed_texture_array);
+
+    /**
+     * @brief Builds the table mapping texture indices to bounding boxes which gets uploaded to the gpu.
+     *
+     * @param file_path_to_packed_texture_info Map from file path to its packed texture metadata.
+     * @param format_to_packed_texture_array The texture arrays the metadata was read with.
+     * @return The bounding box (top left and size in uv space) of every texture index.
+     */
+    std::vector<glm::vec4> populate_texture_index_to_bounding_box(
+        const std::map<std::string, PackedTextureSubTexture> &file_path_to_packed_texture_info,
+        const std::map<TextureFormat, PackedTextureArray> &format_to_packed_texture_array);
+
+    /**
+     * @brief Measures the occupancy, free space and gpu memory of the containers described by the metadata.
+     *
+     * @param file_path_to_packed_texture_info Map from file path to its packed texture metadata.
+     * @param format_to_packed_texture_array The texture arrays the metadata was read with.
+     */
+    AtlasReport
+    build_atlas_report(const std::map<std::string, PackedTextureSubTexture> &file_path_to_packed_texture_info,
+                       const std::map<TextureFormat, PackedTextureArray> &format_to_packed_texture_array) const;
+
+    /** @brief The report of the last bake. */
+    AtlasReport atlas_report;
+
+    /** @brief The number of layers the texture array of the format has on the gpu. */
+    int num_gpu_layers(const PackedTextureArray &packed_texture_array) const;
+
+    /** @brief The residency manager of every format that has more containers than `settings.max_resident_layers`. */
+    std::map<TextureFormat, std::unique_ptr<LayerResidencyManager>> format_to_layer_residency;
+
+    /**
+     * @brief Turns a texture entry of the metadata into a `PackedTextureSubTexture`.
+     *
+     * The texture coordinates and bounding box index are filled in once the whole file has been read, see
+     * read_file_path_to_packed_texture_map.
+     *
+     * @param texture_record The entry as it was streamed from packed_textures.json.
      * @return A `PackedTextureSubTexture` representing the parsed entry.
      */
-    PackedTextureSubTexture parse_sub_texture(const nlohmann::json &sub_texture_json, int atlas_width, int atlas_height,
-                                              int texture_index);
+    PackedTextureSubTexture parse_sub_texture(const PackedTextureRecord &texture_record);
 
-    /** @brief OpenGL texture array object ID storing packed texture layers. */
-    GLuint packed_texture_array_gl_id;
+    /** @brief The buffer texture on GL_TEXTURE1 that shaders read the packed texture bounding boxes from. */
+    GLuint packed_texture_bounding_boxes_gl_id = 0;
 
-    /** @brief OpenGL buffer object ID for packed texture bounding boxes. */
-    GLuint packed_texture_bounding_boxes_gl_id;
+    /** @brief The buffer object holding the bounding boxes, the storage of the buffer texture. */
+    GLuint packed_texture_bounding_boxes_buffer_gl_id = 0;
 
-    /** @brief Map from file path to its packed texture metadata. */
-    // a texture index is simply a unique identifier given to each texture path
-    // note that it has nothing ot do with a packed index or anything like that
-    std::map<std::string, PackedTextureSubTexture> file_path_to_packed_texture_info;
+    /** @brief The number of texels the bounding box buffer was last allocated with, see bounding_box_buffer_size. */
+    size_t bounding_box_buffer_capacity = 0;
+
+    /**
+     * @brief Makes `packed_texture_lookup` the snapshot readers see and frees older snapshots nobody holds anymore.
+     *
+     * Only one thread may publish at a time.
+     */
+    void publish_packed_texture_lookup(std::shared_ptr<const PackedTextureLookup> packed_texture_lookup);
+
+    /** @brief The lookup snapshot readers see, regenerate swaps in a new one once it is fully built. */
+    std::atomic<const PackedTextureLookup *> current_packed_texture_lookup = nullptr;
+
+    /** @brief Owns every published snapshot until no reader can be in the middle of acquiring it. */
+    std::vector<std::shared_ptr<const PackedTextureLookup>> published_packed_texture_lookups;
+
+    /** @brief A reader count on a cache line of its own. */
+    struct alignas(64) LookupReaderCount {
+        std::atomic<int> count = 0;
+    };
+
+    static constexpr size_t num_lookup_reader_shards = 16;
+
+    /**
+     * @brief The number of threads currently inside get_packed_texture_lookup or a lookup function, split into shards
+     * so that readers on different threads don't contend on one counter, each thread always counts in the same shard.
+     */
+    mutable std::array<LookupReaderCount, num_lookup_reader_shards> num_threads_reading_lookup;
+
+    /** @brief The shard of `num_threads_reading_lookup` the calling thread counts itself in. */
+    std::atomic<int> &lookup_reader_count_of_this_thread() const;
 };
 
 #endif // TEXTURE_PACKER_HPP